@@ -0,0 +1,458 @@
+// End-to-end benchmark for the planner.
+//
+// Generates blocksworld instances in the environment file format read by planner.cpp, runs the planner binary on each
+// of them under a wall clock and address space limit, and reports the statistics the planner writes to PLANNER_STATS
+// together with the peak RSS of the child process.
+//
+// Compilation: g++ -std=c++11 -O2 benchmark.cpp -o benchmark
+// Run:         ./benchmark --planner ./a.out --min-blocks 3 --max-blocks 50 --format csv --out results.csv
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+struct BenchmarkOptions
+{
+    string planner = "./a.out";
+    string instance_dir = "bench_instances";
+    string out_file = "";
+    string format = "csv";
+    string baseline = "";
+    int min_blocks = 3;
+    int max_blocks = 50;
+    int step = 1;
+    int random_per_size = 2;
+    unsigned seed = 1;
+    double time_limit = 10;
+    long memory_limit_mb = 2048;
+    double regression_threshold = 0.2;
+    bool generate_only = false;
+};
+
+struct Instance
+{
+    string name;
+    string family;
+    int blocks;
+    string path;
+};
+
+struct BenchmarkResult
+{
+    Instance instance;
+    string status;
+    double wall_seconds = 0;
+    long long expansions = -1;
+    long long generations = -1;
+    double expansions_per_second = 0;
+    long peak_rss_kb = 0;
+    double grounding_seconds = -1;
+    long long plan_length = -1;
+};
+
+//=====================================================================================================================
+
+string block_name(int i)
+{
+    return "B" + to_string(i + 1);
+}
+
+//=====================================================================================================================
+
+// A blocksworld configuration: below[i] is the block under block i, or -1 when block i is on the table.
+vector<int> random_configuration(int blocks, mt19937 &rng)
+{
+    vector<int> order(blocks);
+    for(int i=0;i<blocks;i++)
+        order[i] = i;
+    shuffle(order.begin(),order.end(),rng);
+
+    vector<int> below(blocks,-1);
+    bernoulli_distribution start_new_tower(0.3);
+    for(int i=1;i<blocks;i++)
+    {
+        if(!start_new_tower(rng))
+            below[order[i]] = order[i-1];
+    }
+    return below;
+}
+
+//=====================================================================================================================
+
+vector<int> single_tower(int blocks, bool reversed)
+{
+    vector<int> below(blocks,-1);
+    for(int i=1;i<blocks;i++)
+    {
+        if(reversed)
+            below[i-1] = i;
+        else
+            below[i] = i-1;
+    }
+    return below;
+}
+
+//=====================================================================================================================
+
+string on_conditions(const vector<int> &below)
+{
+    string conditions;
+    for(size_t i=0;i<below.size();i++)
+    {
+        if(i!=0)
+            conditions += ", ";
+        conditions += "On(" + block_name(i) + "," + (below[i]==-1 ? string("Table") : block_name(below[i])) + ")";
+    }
+    return conditions;
+}
+
+//=====================================================================================================================
+
+void write_instance(const string &path, const vector<int> &initial, const vector<int> &goal)
+{
+    int blocks = initial.size();
+    vector<bool> clear(blocks,true);
+    for(int b:initial)
+        if(b!=-1)
+            clear[b] = false;
+
+    ofstream file(path);
+    file<<"Symbols: ";
+    for(int i=0;i<blocks;i++)
+        file<<block_name(i)<<",";
+    file<<"Table"<<"\n";
+
+    file<<"Initial conditions: "<<on_conditions(initial);
+    for(int i=0;i<blocks;i++)
+        file<<", Block("<<block_name(i)<<")";
+    for(int i=0;i<blocks;i++)
+        if(clear[i])
+            file<<", Clear("<<block_name(i)<<")";
+    file<<"\n";
+
+    file<<"Goal conditions: "<<on_conditions(goal)<<"\n\n";
+
+    file<<"Actions:\n"
+        <<"        MoveToTable(b,x)\n"
+        <<"        Preconditions: On(b,x), Clear(b), Block(b), Block(x)\n"
+        <<"        Effects: On(b,Table), Clear(x), !On(b,x)\n\n"
+        <<"        Move(b,x,y)\n"
+        <<"        Preconditions: On(b,x), Clear(b), Clear(y), Block(b), Block(y)\n"
+        <<"        Effects: On(b,y), Clear(x), !On(b,x), !Clear(y)\n";
+}
+
+//=====================================================================================================================
+
+vector<Instance> generate_instances(const BenchmarkOptions &options)
+{
+    mkdir(options.instance_dir.c_str(),0755);
+    mt19937 rng(options.seed);
+    vector<Instance> instances;
+
+    auto add = [&](const string &family, int blocks, const vector<int> &initial, const vector<int> &goal, int id)
+    {
+        Instance instance;
+        instance.family = family;
+        instance.blocks = blocks;
+        instance.name = family + "-" + to_string(blocks) + (id>=0 ? "-" + to_string(id) : "");
+        instance.path = options.instance_dir + "/" + instance.name + ".txt";
+        write_instance(instance.path,initial,goal);
+        instances.push_back(instance);
+    };
+
+    for(int n=options.min_blocks;n<=options.max_blocks;n+=options.step)
+    {
+        vector<int> on_table(n,-1);
+        add("tower-reverse",n,single_tower(n,false),single_tower(n,true),-1);
+        add("unstack",n,single_tower(n,false),on_table,-1);
+        add("stack",n,on_table,single_tower(n,false),-1);
+        for(int k=0;k<options.random_per_size;k++)
+            add("random",n,random_configuration(n,rng),random_configuration(n,rng),k);
+    }
+    return instances;
+}
+
+//=====================================================================================================================
+
+// Pulls a numeric field out of the flat JSON object written by the planner.
+bool json_number(const string &json, const string &key, double &value)
+{
+    auto pos = json.find("\"" + key + "\":");
+    if(pos==string::npos)
+        return false;
+    const char* start = json.c_str() + pos + key.size() + 3;
+    char* end = nullptr;
+    value = strtod(start,&end);
+    return end!=start;
+}
+
+//=====================================================================================================================
+
+BenchmarkResult run_instance(const Instance &instance, const BenchmarkOptions &options)
+{
+    BenchmarkResult result;
+    result.instance = instance;
+    string stats_path = instance.path + ".stats.json";
+    remove(stats_path.c_str());
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if(pid==0)
+    {
+        rlimit memory_limit;
+        memory_limit.rlim_cur = memory_limit.rlim_max = (rlim_t)options.memory_limit_mb * 1024 * 1024;
+        setrlimit(RLIMIT_AS,&memory_limit);
+        int dev_null = open("/dev/null",O_WRONLY);
+        dup2(dev_null,STDOUT_FILENO);
+        dup2(dev_null,STDERR_FILENO);
+        setenv("PLANNER_STATS",stats_path.c_str(),1);
+        execl(options.planner.c_str(),options.planner.c_str(),instance.path.c_str(),(char*)nullptr);
+        _exit(127);
+    }
+    if(pid<0)
+    {
+        result.status = "error";
+        return result;
+    }
+
+    int status = 0;
+    rusage usage;
+    bool timed_out = false;
+    while(true)
+    {
+        pid_t done = wait4(pid,&status,WNOHANG,&usage);
+        if(done==pid)
+            break;
+        if(chrono::duration<double>(chrono::steady_clock::now()-start).count()>options.time_limit)
+        {
+            kill(pid,SIGKILL);
+            wait4(pid,&status,0,&usage);
+            timed_out = true;
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    result.wall_seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    result.peak_rss_kb = usage.ru_maxrss;
+
+    if(timed_out)
+        result.status = "timeout";
+    else if(WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status)!=0))
+        result.status = (WIFEXITED(status) && WEXITSTATUS(status)==127) ? "error" : "memout";     //bad_alloc aborts
+    else
+        result.status = "done";
+
+    ifstream stats_input(stats_path);
+    if(stats_input.is_open())
+    {
+        stringstream buffer;
+        buffer<<stats_input.rdbuf();
+        string json = buffer.str();
+        double value;
+        if(json_number(json,"expansions",value))
+            result.expansions = value;
+        if(json_number(json,"generations",value))
+            result.generations = value;
+        if(json_number(json,"grounding_seconds",value))
+            result.grounding_seconds = value;
+        if(json_number(json,"plan_length",value))
+            result.plan_length = value;
+        if(json_number(json,"search_seconds",value) && value>0 && result.expansions>=0)
+            result.expansions_per_second = result.expansions / value;
+        if(result.status=="done")
+            result.status = result.plan_length>=0 ? "solved" : "unsolved";
+    }
+    return result;
+}
+
+//=====================================================================================================================
+
+void write_csv(ostream &os, const vector<BenchmarkResult> &results)
+{
+    os<<"instance,family,blocks,status,wall_seconds,expansions,generations,expansions_per_second,peak_rss_kb,grounding_seconds,plan_length"<<endl;
+    for(const auto &r:results)
+    {
+        os<<r.instance.name<<","<<r.instance.family<<","<<r.instance.blocks<<","<<r.status<<","<<r.wall_seconds<<","
+          <<r.expansions<<","<<r.generations<<","<<r.expansions_per_second<<","<<r.peak_rss_kb<<","
+          <<r.grounding_seconds<<","<<r.plan_length<<endl;
+    }
+}
+
+//=====================================================================================================================
+
+void write_json(ostream &os, const vector<BenchmarkResult> &results)
+{
+    os<<"["<<endl;
+    for(size_t i=0;i<results.size();i++)
+    {
+        const auto &r = results[i];
+        os<<"  {\"instance\": \""<<r.instance.name<<"\", \"family\": \""<<r.instance.family<<"\", \"blocks\": "<<r.instance.blocks
+          <<", \"status\": \""<<r.status<<"\", \"wall_seconds\": "<<r.wall_seconds<<", \"expansions\": "<<r.expansions
+          <<", \"generations\": "<<r.generations<<", \"expansions_per_second\": "<<r.expansions_per_second
+          <<", \"peak_rss_kb\": "<<r.peak_rss_kb<<", \"grounding_seconds\": "<<r.grounding_seconds
+          <<", \"plan_length\": "<<r.plan_length<<"}"<<(i+1<results.size() ? "," : "")<<endl;
+    }
+    os<<"]"<<endl;
+}
+
+//=====================================================================================================================
+
+// Compares against a CSV written by an earlier run and reports instances that got slower or stopped being solved.
+int compare_with_baseline(const vector<BenchmarkResult> &results, const BenchmarkOptions &options)
+{
+    ifstream baseline_file(options.baseline);
+    if(!baseline_file.is_open())
+    {
+        cerr<<"Unable to open baseline "<<options.baseline<<endl;
+        return 1;
+    }
+
+    unordered_map<string,vector<string>> baseline_rows;
+    string line;
+    getline(baseline_file,line);
+    while(getline(baseline_file,line))
+    {
+        vector<string> fields;
+        stringstream row(line);
+        string field;
+        while(getline(row,field,','))
+            fields.push_back(field);
+        if(fields.size()==11)
+            baseline_rows[fields[0]] = fields;
+    }
+
+    int regressions = 0;
+    for(const auto &r:results)
+    {
+        auto found = baseline_rows.find(r.instance.name);
+        if(found==baseline_rows.end())
+            continue;
+        const auto &old_row = found->second;
+        if(old_row[3]=="solved" && r.status!="solved")
+        {
+            cout<<"REGRESSION "<<r.instance.name<<": was solved, now "<<r.status<<endl;
+            regressions++;
+            continue;
+        }
+        double old_wall = atof(old_row[4].c_str());
+        if(old_row[3]=="solved" && old_wall>0.05 && r.wall_seconds>old_wall*(1+options.regression_threshold))
+        {
+            cout<<"REGRESSION "<<r.instance.name<<": wall time "<<old_wall<<"s -> "<<r.wall_seconds<<"s"<<endl;
+            regressions++;
+        }
+        long old_rss = atol(old_row[8].c_str());
+        if(old_rss>0 && r.peak_rss_kb>old_rss*(1+options.regression_threshold))
+        {
+            cout<<"REGRESSION "<<r.instance.name<<": peak RSS "<<old_rss<<"kB -> "<<r.peak_rss_kb<<"kB"<<endl;
+            regressions++;
+        }
+    }
+    cout<<regressions<<" regression(s) against "<<options.baseline<<endl;
+    return regressions ? 2 : 0;
+}
+
+//=====================================================================================================================
+
+void print_usage(const char* program)
+{
+    cout<<"Usage: "<<program<<" [options]"<<endl
+        <<"  --planner PATH            planner binary (default ./a.out)"<<endl
+        <<"  --instances DIR           where generated instances are written (default bench_instances)"<<endl
+        <<"  --min-blocks N            smallest instance (default 3)"<<endl
+        <<"  --max-blocks N            largest instance (default 50)"<<endl
+        <<"  --step N                  block count increment (default 1)"<<endl
+        <<"  --random N                random instances per size (default 2)"<<endl
+        <<"  --seed N                  random seed (default 1)"<<endl
+        <<"  --time-limit SECONDS      per instance wall clock limit (default 10)"<<endl
+        <<"  --memory-limit-mb MB      per instance address space limit (default 2048)"<<endl
+        <<"  --format csv|json         report format (default csv)"<<endl
+        <<"  --out FILE                write the report to FILE instead of stdout"<<endl
+        <<"  --baseline FILE           CSV report of an earlier run to check for regressions"<<endl
+        <<"  --threshold FRACTION      allowed slowdown against the baseline (default 0.2)"<<endl
+        <<"  --generate-only           only write the instance files"<<endl;
+}
+
+//=====================================================================================================================
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    for(int i=1;i<argc;i++)
+    {
+        string arg = argv[i];
+        auto value = [&]() -> string
+        {
+            if(i+1>=argc)
+            {
+                cerr<<"Missing value for "<<arg<<endl;
+                exit(1);
+            }
+            return argv[++i];
+        };
+        if(arg=="--planner") options.planner = value();
+        else if(arg=="--instances") options.instance_dir = value();
+        else if(arg=="--min-blocks") options.min_blocks = atoi(value().c_str());
+        else if(arg=="--max-blocks") options.max_blocks = atoi(value().c_str());
+        else if(arg=="--step") options.step = max(1,atoi(value().c_str()));
+        else if(arg=="--random") options.random_per_size = atoi(value().c_str());
+        else if(arg=="--seed") options.seed = strtoul(value().c_str(),nullptr,10);
+        else if(arg=="--time-limit") options.time_limit = atof(value().c_str());
+        else if(arg=="--memory-limit-mb") options.memory_limit_mb = atol(value().c_str());
+        else if(arg=="--format") options.format = value();
+        else if(arg=="--out") options.out_file = value();
+        else if(arg=="--baseline") options.baseline = value();
+        else if(arg=="--threshold") options.regression_threshold = atof(value().c_str());
+        else if(arg=="--generate-only") options.generate_only = true;
+        else
+        {
+            print_usage(argv[0]);
+            return arg=="--help" ? 0 : 1;
+        }
+    }
+
+    auto instances = generate_instances(options);
+    if(options.generate_only)
+    {
+        cout<<"Wrote "<<instances.size()<<" instances to "<<options.instance_dir<<endl;
+        return 0;
+    }
+
+    vector<BenchmarkResult> results;
+    for(const auto &instance:instances)
+    {
+        results.push_back(run_instance(instance,options));
+        cerr<<instance.name<<": "<<results.back().status<<" ("<<results.back().wall_seconds<<"s)"<<endl;
+    }
+
+    ofstream out_file;
+    if(options.out_file!="")
+        out_file.open(options.out_file);
+    ostream &os = options.out_file!="" ? out_file : cout;
+    if(options.format=="json")
+        write_json(os,results);
+    else
+        write_csv(os,results);
+
+    if(options.baseline!="")
+        return compare_with_baseline(results,options);
+    return 0;
+}
@@ -0,0 +1,310 @@
+// Microbenchmarks for the inner kernels of planner.cpp.
+//
+// Every kernel is measured on blocksworld tasks of several sizes. A measurement is a number of repetitions, each one
+// calibrated to run for at least --min-time-ms, and the report gives the median, mean, standard deviation, minimum
+// and the median absolute deviation of the time per call so that noisy numbers are easy to spot.
+//
+// Compilation: g++ -std=c++11 -O2 -pthread microbench.cpp -o microbench
+// Run:         ./microbench --blocks 3,10,25,50 --repetitions 15 --min-time-ms 20
+
+#define PLANNER_NO_MAIN
+#include "planner.cpp"
+
+#include <cmath>
+#include <iomanip>
+
+struct MicrobenchOptions
+{
+    vector<int> blocks = {3, 10, 25, 50};
+    int repetitions = 15;
+    double min_time_ms = 20;
+    string filter = "";
+    bool csv = false;
+};
+
+struct MicrobenchResult
+{
+    string kernel;
+    int blocks;
+    size_t actions;
+    size_t state_size;
+    long long iterations;
+    double median_ns;
+    double mean_ns;
+    double stddev_ns;
+    double min_ns;
+    double mad_ns;
+};
+
+volatile size_t benchmark_sink = 0;     //Results are folded in here so the compiler cannot drop the measured work
+
+//=====================================================================================================================
+
+// The blocksworld domain of example.txt with n blocks stacked in a single tower.
+Env* make_blocksworld_env(int blocks)
+{
+    Env* env = new Env();
+    env->add_symbol("Table");
+    for(int i=0;i<blocks;i++)
+    {
+        string block = "B" + to_string(i + 1);
+        env->add_symbol(block);
+        env->add_initial_condition(GroundedCondition("Block",{block}));
+        env->add_initial_condition(GroundedCondition("On",{block,i==0 ? string("Table") : "B" + to_string(i)}));
+        env->add_goal_condition(GroundedCondition("On",{block,i==blocks-1 ? string("Table") : "B" + to_string(i + 2)}));
+    }
+    env->add_initial_condition(GroundedCondition("Clear",{"B" + to_string(blocks)}));
+
+    unordered_set<Condition, ConditionHasher, ConditionComparator> preconditions{
+        Condition("On",{"b","x"},true), Condition("Clear",{"b"},true), Condition("Block",{"b"},true), Condition("Block",{"x"},true)};
+    unordered_set<Condition, ConditionHasher, ConditionComparator> effects{
+        Condition("On",{"b","Table"},true), Condition("Clear",{"x"},true), Condition("On",{"b","x"},false)};
+    env->add_action(Action("MoveToTable",{"b","x"},preconditions,effects));
+
+    preconditions = {Condition("On",{"b","x"},true), Condition("Clear",{"b"},true), Condition("Clear",{"y"},true),
+                     Condition("Block",{"b"},true), Condition("Block",{"y"},true)};
+    effects = {Condition("On",{"b","y"},true), Condition("Clear",{"x"},true), Condition("On",{"b","x"},false),
+               Condition("Clear",{"y"},false)};
+    env->add_action(Action("Move",{"b","x","y"},preconditions,effects));
+    return env;
+}
+
+//=====================================================================================================================
+
+template <typename F>
+MicrobenchResult measure(const string &kernel, int blocks, size_t actions, size_t state_size,
+                         const MicrobenchOptions &options, F &&body)
+{
+    // Calibrate the iteration count so that one repetition lasts at least min_time_ms
+    long long iterations = 1;
+    while(true)
+    {
+        auto start = chrono::steady_clock::now();
+        for(long long i=0;i<iterations;i++)
+            body();
+        double elapsed_ms = chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+        if(elapsed_ms>=options.min_time_ms || iterations>=(1LL<<30))
+            break;
+        iterations *= elapsed_ms<options.min_time_ms/10 ? 10 : 2;
+    }
+
+    vector<double> samples;
+    for(int r=0;r<options.repetitions;r++)
+    {
+        auto start = chrono::steady_clock::now();
+        for(long long i=0;i<iterations;i++)
+            body();
+        samples.push_back(chrono::duration<double,nano>(chrono::steady_clock::now()-start).count() / iterations);
+    }
+
+    sort(samples.begin(),samples.end());
+    MicrobenchResult result{kernel,blocks,actions,state_size,iterations,0,0,0,samples.front(),0};
+    result.median_ns = samples[samples.size()/2];
+    for(double s:samples)
+        result.mean_ns += s;
+    result.mean_ns /= samples.size();
+    vector<double> deviations;
+    for(double s:samples)
+    {
+        result.stddev_ns += (s-result.mean_ns)*(s-result.mean_ns);
+        deviations.push_back(fabs(s-result.median_ns));
+    }
+    result.stddev_ns = sqrt(result.stddev_ns / samples.size());
+    sort(deviations.begin(),deviations.end());
+    result.mad_ns = deviations[deviations.size()/2];
+    return result;
+}
+
+//=====================================================================================================================
+
+vector<MicrobenchResult> run_kernels(int blocks, const MicrobenchOptions &options)
+{
+    vector<MicrobenchResult> results;
+    auto wanted = [&](const string &kernel) { return options.filter=="" || kernel.find(options.filter)!=string::npos; };
+
+    Env* env = make_blocksworld_env(blocks);
+    const auto schemas = env->get_all_actions();
+    const auto symbols = env->get_symbols();
+    const auto action_list = get_all_possible_actions(schemas,symbols);
+    const auto state = env->get_initial_conditions();
+    const auto goal = env->get_goal_conditions();
+    const size_t n_actions = action_list.size();
+    const size_t n_state = state.size();
+
+    // The action that moves the top block to the table is applicable in the initial state
+    const GroundedAction* applicable = nullptr;
+    for(const auto &gaction:action_list)
+    {
+        if(are_all_elements_present_in_collection(gaction.get_preconditions(),state))
+        {
+            applicable = &gaction;
+            break;
+        }
+    }
+
+    if(wanted("GroundedConditionHasher"))
+    {
+        vector<GroundedCondition> atoms(state.begin(),state.end());
+        results.push_back(measure("GroundedConditionHasher",blocks,n_actions,n_state,options,[&]()
+        {
+            size_t h = 0;
+            for(const auto &atom:atoms)
+                h ^= GroundedConditionHasher{}(atom);
+            benchmark_sink += h;
+        }));
+    }
+
+    if(wanted("are_all_elements_present_in_collection"))
+    {
+        const auto preconditions = applicable->get_preconditions();
+        results.push_back(measure("are_all_elements_present_in_collection",blocks,n_actions,n_state,options,[&]()
+        {
+            benchmark_sink += are_all_elements_present_in_collection(preconditions,state);
+        }));
+        results.push_back(measure("applicability_scan",blocks,n_actions,n_state,options,[&]()
+        {
+            size_t applicable_count = 0;
+            for(const auto &gaction:action_list)
+                applicable_count += are_all_elements_present_in_collection(gaction.get_preconditions(),state);
+            benchmark_sink += applicable_count;
+        }));
+    }
+
+    if(wanted("action_table_scan"))
+    {
+        // The same scan over the struct-of-arrays table, once per kernel the CPU can run
+        const GroundedTask task = ground_task(env,false);
+        const ActionTable table(task);
+        vector<uint64_t> state_bits(table.words());
+        table.state_bits(task.initial_state,state_bits.data());
+        vector<pair<string,int>> kernels{{"scalar",SCAN_SCALAR}};
+        if(ActionTable::best_kernel()>=SCAN_SSE2)
+            kernels.push_back({"sse2",SCAN_SSE2});
+        if(ActionTable::best_kernel()>=SCAN_AVX2)
+            kernels.push_back({"avx2",SCAN_AVX2});
+        vector<int> applicable_actions;
+        for(const auto &kernel:kernels)
+        {
+            results.push_back(measure("action_table_scan_" + kernel.first,blocks,n_actions,n_state,options,[&]()
+            {
+                table.applicable_actions(state_bits.data(),applicable_actions,kernel.second);
+                benchmark_sink += applicable_actions.size();
+            }));
+        }
+    }
+
+    if(wanted("get_new_grounded_conditions"))
+    {
+        const auto effects = applicable->get_effects();
+        results.push_back(measure("get_new_grounded_conditions",blocks,n_actions,n_state,options,[&]()
+        {
+            benchmark_sink += get_new_grounded_conditions(state,effects).size();
+        }));
+    }
+
+    if(wanted("get_grounded_conditions"))
+    {
+        const auto move = env->get_action("Move");
+        const auto preconditions = move.get_preconditions();
+        unordered_map<string,string> placeholder_to_symbol_map{{"b","B1"},{"x","Table"},{"y","B2"}};
+        results.push_back(measure("get_grounded_conditions",blocks,n_actions,n_state,options,[&]()
+        {
+            benchmark_sink += get_grounded_conditions(preconditions,placeholder_to_symbol_map).size();
+        }));
+    }
+
+    if(wanted("get_all_possible_permutations"))
+    {
+        results.push_back(measure("get_all_possible_permutations",blocks,n_actions,n_state,options,[&]()
+        {
+            benchmark_sink += get_all_possible_permutations(schemas,symbols).size();
+        }));
+    }
+
+    if(wanted("priority_queue"))
+    {
+        // Push then pop a batch of nodes the size of one expansion, as expand_state and the search loop do
+        vector<Node> nodes;
+        for(size_t i=0;i<min<size_t>(n_actions,64);i++)
+        {
+            nodes.emplace_back(Node{state,(double)(i%7),(int)i});
+            nodes.back().set_hcost((double)(i%5));
+        }
+        results.push_back(measure("priority_queue_push_pop",blocks,n_actions,n_state,options,[&]()
+        {
+            priority_queue<Node, vector<Node>, Node_Comp> open;
+            for(const auto &node:nodes)
+                open.push(node);
+            while(!open.empty())
+            {
+                benchmark_sink += open.top().index_in_map;
+                open.pop();
+            }
+        }));
+    }
+
+    delete env;
+    return results;
+}
+
+//=====================================================================================================================
+
+void print_results(const vector<MicrobenchResult> &results, bool csv)
+{
+    if(csv)
+    {
+        cout<<"kernel,blocks,actions,state_size,iterations,median_ns,mean_ns,stddev_ns,min_ns,mad_ns"<<endl;
+        for(const auto &r:results)
+            cout<<r.kernel<<","<<r.blocks<<","<<r.actions<<","<<r.state_size<<","<<r.iterations<<","<<r.median_ns<<","
+                <<r.mean_ns<<","<<r.stddev_ns<<","<<r.min_ns<<","<<r.mad_ns<<endl;
+        return;
+    }
+
+    cout<<left<<setw(40)<<"kernel"<<right<<setw(7)<<"blocks"<<setw(9)<<"actions"<<setw(7)<<"state"
+        <<setw(14)<<"median ns"<<setw(14)<<"mean ns"<<setw(12)<<"stddev"<<setw(14)<<"min ns"<<setw(9)<<"mad %"<<endl;
+    for(const auto &r:results)
+    {
+        cout<<left<<setw(40)<<r.kernel<<right<<setw(7)<<r.blocks<<setw(9)<<r.actions<<setw(7)<<r.state_size
+            <<fixed<<setprecision(1)<<setw(14)<<r.median_ns<<setw(14)<<r.mean_ns<<setw(12)<<r.stddev_ns
+            <<setw(14)<<r.min_ns<<setw(9)<<(r.median_ns>0 ? 100*r.mad_ns/r.median_ns : 0)<<endl;
+    }
+}
+
+//=====================================================================================================================
+
+int main(int argc, char* argv[])
+{
+    MicrobenchOptions options;
+    for(int i=1;i<argc;i++)
+    {
+        string arg = argv[i];
+        if(arg=="--blocks" && i+1<argc)
+        {
+            options.blocks.clear();
+            for(const auto &b:parse_symbols(argv[++i]))
+                options.blocks.push_back(atoi(b.c_str()));
+        }
+        else if(arg=="--repetitions" && i+1<argc)
+            options.repetitions = max(1,atoi(argv[++i]));
+        else if(arg=="--min-time-ms" && i+1<argc)
+            options.min_time_ms = atof(argv[++i]);
+        else if(arg=="--filter" && i+1<argc)
+            options.filter = argv[++i];
+        else if(arg=="--csv")
+            options.csv = true;
+        else
+        {
+            cout<<"Usage: "<<argv[0]<<" [--blocks 3,10,25,50] [--repetitions N] [--min-time-ms MS] [--filter KERNEL] [--csv]"<<endl;
+            return arg=="--help" ? 0 : 1;
+        }
+    }
+
+    vector<MicrobenchResult> results;
+    for(int blocks:options.blocks)
+    {
+        auto block_results = run_kernels(blocks,options);
+        results.insert(results.end(),block_results.begin(),block_results.end());
+    }
+    print_results(results,options.csv);
+    return 0;
+}
@@ -4,12 +4,45 @@
 #include <regex>
 #include <unordered_set>
 #include <set>
+#include <map>
 #include <list>
 #include <unordered_map>
 #include <algorithm>
 #include <stdexcept>
 #include <queue>
+#include <deque>
 #include <climits>
+#include <limits>
+#include <iterator>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <cerrno>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <cstdint>
+#include <tuple>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #define SYMBOLS 0
 #define INITIAL 1
@@ -19,15 +52,147 @@
 #define ACTION_PRECONDITION 5
 #define ACTION_EFFECT 6
 
+#define LOG_SILENT 0
+#define LOG_INFO 1
+#define LOG_DEBUG 2
+
+#define SEARCH_ASTAR 0
+#define SEARCH_REGRESSION 1
+#define SEARCH_BIDIRECTIONAL 2
+#define SEARCH_IDASTAR 3
+#define SEARCH_EXTERNAL 4
+#define SEARCH_INCREMENTAL 5
+#define SEARCH_PORTFOLIO 6
+#define SEARCH_LIFTED 7
+#define SEARCH_IW 8
+#define SEARCH_BFWS 9
+#define SEARCH_BEAM 10
+#define SEARCH_DISTRIBUTED 11
+
+#define MEMORY_STOP 0
+#define MEMORY_EVICT 1
+#define MEMORY_BEAM 2
+
+#define STEP_RUNNING 0
+#define STEP_SOLVED 1
+#define STEP_FAILED 2
+#define STEP_CANCELLED 3
+
+#define SCAN_AUTO -1
+#define SCAN_SCALAR 0
+#define SCAN_SSE2 1
+#define SCAN_AVX2 2
+
 class GroundedCondition;
 class Condition;
 class GroundedAction;
 class Action;
 class Env;
+class ObjectSymmetries;
+struct GroundedTask;
+class FiniteDomainTask;
 
 using namespace std;
 
 bool print_status = true;
+int search_mode = SEARCH_ASTAR;    //PLANNER_SEARCH
+int log_level = LOG_SILENT;      //LOG_DEBUG prints every expanded node (PLANNER_LOG_LEVEL)
+
+// Settings declared thread_local below are chosen per configuration by portfolio_planner, whose searches run on
+// their own threads.
+
+// Strong stubborn set pruning in A* (PLANNER_STUBBORN_SETS). Interference lists are precomputed up to this many entries.
+// When less than stubborn_min_pruned_ratio of the applicable actions are pruned over the first stubborn_trial_expansions
+// expansions (PLANNER_STUBBORN_TRIAL, 0 never gives up), the search drops the stubborn sets and expands everything.
+thread_local bool use_stubborn_sets = false;
+size_t stubborn_interference_budget = 20000000;
+long long stubborn_trial_expansions = 1000;
+double stubborn_min_pruned_ratio = 0.02;
+
+// Duplicate detection modulo object symmetries in A* (PLANNER_SYMMETRY).
+thread_local bool use_symmetry_pruning = false;
+
+// Backward relevance analysis after grounding (PLANNER_RELEVANCE, on by default).
+bool use_relevance_analysis = true;
+
+// h^2 mutex analysis after grounding (PLANNER_H2, on by default), skipped when actions * atoms exceeds the budget.
+bool use_h2_mutexes = true;
+double h2_work_budget = 2e8;
+
+// Number of transposition table entries used by IDA* (PLANNER_TT_SIZE).
+size_t transposition_table_size = 1 << 20;
+
+// External-memory search: layer files go under this directory, successor buffers stay within the budget
+// (PLANNER_EXTERNAL_DIR, PLANNER_EXTERNAL_BUDGET_MB).
+string external_search_dir = "/tmp";
+size_t external_memory_budget = (size_t)256 << 20;
+
+// Kernel of the ActionTable applicability scan (PLANNER_SIMD): SCAN_AUTO takes the widest one the CPU supports.
+int applicability_kernel = SCAN_AUTO;
+
+// Novelty searches (PLANNER_SEARCH=iw|bfws): IW runs IW(1) up to IW(novelty_max_width) and BFWS measures novelty up
+// to that width (PLANNER_NOVELTY_WIDTH). Atom pair tables above novelty_dense_pair_bits are kept as hash sets.
+int novelty_max_width = 2;
+uint64_t novelty_dense_pair_bits = (uint64_t)1 << 27;
+
+// Beam search (PLANNER_SEARCH=beam): states kept per layer, restarts with a doubled width after a failure, threads
+// that expand a layer (0 for one per core) and the depth at which a beam gives up (PLANNER_BEAM_WIDTH,
+// PLANNER_BEAM_RESTARTS, PLANNER_BEAM_THREADS, PLANNER_BEAM_MAX_DEPTH).
+size_t beam_width = 100;
+int beam_restarts = 0;
+unsigned beam_threads = 0;
+int beam_max_depth = 1000;
+
+// Distributed search (PLANNER_SEARCH=distributed): forked worker processes on this machine (PLANNER_DISTRIBUTED_WORKERS),
+// or one process per host:port of PLANNER_DISTRIBUTED_PEERS with this process at PLANNER_DISTRIBUTED_RANK. Successors
+// are sent in batches of distributed_batch_bytes.
+int distributed_workers = 4;
+string distributed_peers = "";
+int distributed_rank = 0;
+double distributed_connect_timeout = 60;
+size_t distributed_batch_bytes = 1 << 16;
+
+// Memory ceiling for A* in bytes, 0 for none (PLANNER_MEMORY_LIMIT_MB). What happens when it is reached is decided by
+// memory_policy (PLANNER_MEMORY_POLICY): stop with partial statistics, evict the closed list, or evict and continue as
+// a beam search of memory_beam_width nodes ordered by gcost plus unsatisfied goal conditions
+// (PLANNER_MEMORY_BEAM_WIDTH). The ceiling applies to each search thread separately.
+size_t memory_limit_bytes = 0;
+int memory_policy = MEMORY_STOP;
+size_t memory_beam_width = 1000;
+
+// Portfolio search (PLANNER_SEARCH=portfolio): the configurations run concurrently (PLANNER_PORTFOLIO) and the first
+// result wins. With a deadline in seconds (PLANNER_PORTFOLIO_DEADLINE) the shortest plan found by then wins instead.
+string portfolio_configurations = "astar,astar+stubborn,astar+symmetry,bidirectional,idastar";
+double portfolio_deadline = 0;
+
+// Set on the threads of portfolio_planner. A search polls search_cancelled() once per expansion and gives up when it
+// returns true, reporting no plan.
+thread_local const atomic<bool>* cancel_flag = nullptr;
+
+// Macro-operators (PLANNER_MACROS=dir): solved plans are collected per domain under macro_dir and mined for action
+// subsequences of up to macro_max_length steps seen at least macro_min_support times (PLANNER_MACRO_LENGTH,
+// PLANNER_MACRO_MIN_SUPPORT). The macro_limit best ones with at most macro_max_parameters parameters are added to
+// the grounded actions of later queries of the domain (PLANNER_MACRO_LIMIT, PLANNER_MACRO_MAX_PARAMS). Without
+// learning (PLANNER_MACRO_LEARN=0) the macros are used but the corpus and the macro file stay as they are.
+bool use_macros = false;
+bool learn_new_macros = true;
+string macro_dir = "macros";
+int macro_max_length = 3;
+int macro_min_support = 3;
+size_t macro_limit = 4;
+int macro_max_parameters = 4;
+
+// Plan cache. Enabled by pointing the PLANNER_PLAN_CACHE environment variable at a directory.
+bool plan_cache_enabled = false;
+string plan_cache_dir = "plan_cache";
+size_t plan_cache_capacity = 64;
+
+// Search statistics are written as JSON to this file when it is set, "-" writes them to stderr (PLANNER_STATS).
+string stats_file = "";
+
+// Binary search trace (PLANNER_TRACE), recorded for the given fraction of queries (PLANNER_TRACE_SAMPLE).
+thread_local string trace_file = "";
+double trace_sample_rate = 1.0;
 
 class GroundedCondition
 {
@@ -525,8 +690,104 @@ list<string> parse_symbols(string symbols_str)
     return symbols;
 }
 
+struct SearchStatistics
+{
+    long long expansions = 0;
+    long long generations = 0;
+    long long duplicates = 0;
+    long long reopenings = 0;
+    long long pruned_actions = 0;                //Applicable actions pruned by stubborn sets during their trial
+    long long stubborn_disabled_at = -1;        //Expansion after which stubborn sets were given up
+    size_t symmetry_generators = 0;
+    long long heuristic_evaluations = 0;
+    double heuristic_seconds = 0;
+    size_t open_peak = 0;
+    long long plan_length = -1;
+    double parse_seconds = 0;
+    double grounding_seconds = 0;
+    double search_seconds = 0;
+    double backtrack_seconds = 0;
+    bool solved = false;
+    bool cache_hit = false;
+    bool out_of_memory = false;
+    string portfolio_winner = "";
+    long long memory_evictions = 0;
+    size_t memory_peak_bytes = 0;
+    size_t packed_state_bytes = 0;
+    long long h2_mutex_pairs = 0;
+    long long h2_pruned_actions = 0;
+    long long relevance_pruned_actions = 0;
+    long long relevance_pruned_atoms = 0;
+    long long novelty_pruned = 0;
+    int novelty_width = 0;
+    size_t macro_schemas = 0;
+    size_t macro_actions = 0;
+    long long macro_plan_steps = 0;
+
+    void write_json(ostream &os) const
+    {
+        os<<"{\"solved\": "<<(solved ? "true" : "false")
+          <<", \"cache_hit\": "<<(cache_hit ? "true" : "false")
+          <<", \"out_of_memory\": "<<(out_of_memory ? "true" : "false")
+          <<", \"portfolio_winner\": \""<<portfolio_winner<<"\""
+          <<", \"expansions\": "<<expansions
+          <<", \"generations\": "<<generations
+          <<", \"duplicates\": "<<duplicates
+          <<", \"reopenings\": "<<reopenings
+          <<", \"pruned_actions\": "<<pruned_actions
+          <<", \"stubborn_disabled_at\": "<<stubborn_disabled_at
+          <<", \"symmetry_generators\": "<<symmetry_generators
+          <<", \"heuristic_evaluations\": "<<heuristic_evaluations
+          <<", \"heuristic_seconds\": "<<heuristic_seconds
+          <<", \"open_peak\": "<<open_peak
+          <<", \"plan_length\": "<<plan_length
+          <<", \"memory_peak_bytes\": "<<memory_peak_bytes
+          <<", \"memory_evictions\": "<<memory_evictions
+          <<", \"packed_state_bytes\": "<<packed_state_bytes
+          <<", \"h2_mutex_pairs\": "<<h2_mutex_pairs
+          <<", \"h2_pruned_actions\": "<<h2_pruned_actions
+          <<", \"relevance_pruned_actions\": "<<relevance_pruned_actions
+          <<", \"relevance_pruned_atoms\": "<<relevance_pruned_atoms
+          <<", \"novelty_pruned\": "<<novelty_pruned
+          <<", \"novelty_width\": "<<novelty_width
+          <<", \"macro_schemas\": "<<macro_schemas
+          <<", \"macro_actions\": "<<macro_actions
+          <<", \"macro_plan_steps\": "<<macro_plan_steps
+          <<", \"phases\": {\"parse_seconds\": "<<parse_seconds
+          <<", \"grounding_seconds\": "<<grounding_seconds
+          <<", \"search_seconds\": "<<search_seconds
+          <<", \"backtrack_seconds\": "<<backtrack_seconds<<"}}"<<endl;
+    }
+};
+
+thread_local SearchStatistics search_stats;
+
+//=====================================================================================================================
+
+bool search_cancelled()
+{
+    return cancel_flag && cancel_flag->load(memory_order_relaxed);
+}
+
+//=====================================================================================================================
+
+double seconds_since(const chrono::steady_clock::time_point &start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now()-start).count();
+}
+
+//=====================================================================================================================
+
+bool log_enabled(int level)
+{
+    return log_level>=level;
+}
+
+//=====================================================================================================================
+
 Env* create_env(char* filename)
 {
+    auto parse_start = chrono::steady_clock::now();
     ifstream input_file(filename);
     Env* env = new Env();
     regex symbolStateRegex("symbols:", regex::icase);
@@ -787,6 +1048,7 @@ Env* create_env(char* filename)
     else
         cout << "Unable to open file";
 
+    search_stats.parse_seconds = seconds_since(parse_start);
     return env;
 }
 
@@ -795,12 +1057,15 @@ Env* create_env(char* filename)
 struct Node
 {
     unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> gc;
+    string packed;      //A* over a grounded task stores the state here instead of in gc, see StateKeys
     vector<int> neighbors;
-    vector<GroundedAction> parent_gaction;   //This stores, what action of the parent led to this state
+    vector<GroundedAction> parent_gaction;   //This stores, what action of the parent led to this state. Empty for
+                                             //packed nodes, whose action_index points into the grounded task
     double gcost;
     double hcost;
     double fcost;
     int index_in_map;
+    int action_index = -1;      //Index of parent_gaction in the grounded action list, -1 for the start node
     static double heuristic_weight;
 
     //---------------------------------------------------------
@@ -897,6 +1162,211 @@ struct Node_Comp{
 
 //=====================================================================================================================
 
+// Memory accounting for the A* search. PoolAllocator hands out single objects from per-type free lists that are
+// refilled in blocks, and every allocation it serves is charged to memory_accountant. The containers of astar_planner
+// use it; the heap memory owned by a Node (its state, parent action, strings) is charged through
+// approximate_node_bytes when the node enters and leaves a container. The accountant is per thread like the pools, so
+// every search of a portfolio has the whole ceiling to itself.
+class MemoryAccountant
+{
+private:
+    size_t in_use = 0;
+    size_t peak = 0;
+
+public:
+    void charge(size_t bytes)
+    {
+        this->in_use += bytes;
+        this->peak = max(this->peak,this->in_use);
+    }
+
+    void release(size_t bytes)
+    {
+        this->in_use -= bytes;
+    }
+
+    size_t bytes_in_use() const
+    {
+        return this->in_use;
+    }
+
+    size_t peak_bytes() const
+    {
+        return this->peak;
+    }
+
+    void reset_peak()
+    {
+        this->peak = this->in_use;
+    }
+};
+
+thread_local MemoryAccountant memory_accountant;
+
+//=====================================================================================================================
+
+// Pools are per thread and give their blocks back when the thread exits, so a container using PoolAllocator must not
+// outlive the thread that created it.
+template <typename T>
+class PoolAllocator
+{
+private:
+    struct Pool
+    {
+        static const size_t objects_per_block = 1024;
+        vector<void*> blocks;
+        void* head = nullptr;
+
+        ~Pool()
+        {
+            for(void* block:blocks)
+                ::operator delete(block);
+        }
+
+        static size_t chunk_size()
+        {
+            size_t size = max(sizeof(T),sizeof(void*));
+            size_t alignment = max(alignof(T),alignof(void*));
+            return (size+alignment-1)/alignment*alignment;
+        }
+
+        void* take()
+        {
+            if(!head)
+            {
+                char* block = static_cast<char*>(::operator new(chunk_size()*objects_per_block));
+                blocks.push_back(block);
+                for(size_t i=0;i<objects_per_block;i++)
+                    give(block+i*chunk_size());
+            }
+            void* chunk = head;
+            head = *static_cast<void**>(head);
+            return chunk;
+        }
+
+        void give(void* chunk)
+        {
+            *static_cast<void**>(chunk) = head;
+            head = chunk;
+        }
+    };
+
+    static Pool& pool()
+    {
+        static thread_local Pool thread_pool;
+        return thread_pool;
+    }
+
+public:
+    typedef T value_type;
+
+    PoolAllocator()
+    {
+    }
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        memory_accountant.charge(n*sizeof(T));
+        if(n==1)
+            return static_cast<T*>(pool().take());
+        return static_cast<T*>(::operator new(n*sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        memory_accountant.release(n*sizeof(T));
+        if(n==1)
+            pool().give(p);
+        else
+            ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U> &) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U> &) const
+    {
+        return false;
+    }
+};
+
+//=====================================================================================================================
+
+typedef unordered_map<int, Node, hash<int>, equal_to<int>, PoolAllocator<pair<const int, Node>>> NodeMap;
+typedef unordered_map<string, double, hash<string>, equal_to<string>, PoolAllocator<pair<const string, double>>> StateGcostMap;
+typedef unordered_set<string, hash<string>, equal_to<string>, PoolAllocator<string>> StateKeySet;
+
+// A deque grows and shrinks in small blocks, where a vector would double its capacity past the memory ceiling and keep
+// it after the nodes are popped.
+struct OpenList : public priority_queue<Node, deque<Node, PoolAllocator<Node>>, Node_Comp>
+{
+    const deque<Node, PoolAllocator<Node>>& nodes() const
+    {
+        return this->c;
+    }
+
+    // Keeps only the width best nodes
+    void trim(size_t width);
+};
+
+//=====================================================================================================================
+
+size_t string_heap_bytes(const string &s)
+{
+    return s.size()>15 ? s.size()+1 : 0;     //Short strings live inside the string object. Copies of a string can
+                                             //differ in capacity, so the size is what is charged
+}
+
+size_t approximate_conditions_bytes(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &conditions)
+{
+    size_t bytes = conditions.size()*sizeof(void*);      //Buckets, at the default load factor
+    for(const auto &condition:conditions)
+    {
+        bytes += sizeof(GroundedCondition) + 2*sizeof(void*) + condition.get_predicate().size();
+        bytes += condition.get_arg_values().size()*(sizeof(string) + 2*sizeof(void*));
+    }
+    return bytes;
+}
+
+// Heap memory owned by a node outside of the container slot it lives in.
+size_t approximate_node_bytes(const Node &node)
+{
+    size_t bytes = approximate_conditions_bytes(node.gc) + string_heap_bytes(node.packed)
+                   + node.neighbors.capacity()*sizeof(int);
+    for(const auto &gaction:node.parent_gaction)
+        bytes += sizeof(GroundedAction) + approximate_conditions_bytes(gaction.get_preconditions())
+                 + approximate_conditions_bytes(gaction.get_effects());
+    return bytes;
+}
+
+//=====================================================================================================================
+
+void OpenList::trim(size_t width)
+{
+    if(this->size()<=width)
+        return;
+    OpenList kept;
+    while(kept.size()<width)
+    {
+        kept.push(this->top());
+        this->pop();
+    }
+    for(const auto &node:this->c)
+        memory_accountant.release(approximate_node_bytes(node));
+    this->swap(kept);
+}
+
+//=====================================================================================================================
+
 template <typename T>
 void print_unordered_set(const unordered_set<T> &u_set)
 {
@@ -1070,7 +1540,7 @@ unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionCompa
         else
         {
             effect.set_truth(true);
-            present_grounded_conditions.erase(present_grounded_conditions.find(effect));
+            present_grounded_conditions.erase(effect);
         }
     }
 
@@ -1094,40 +1564,188 @@ bool are_all_elements_present_in_collection(const unordered_set<GroundedConditio
 
 //=====================================================================================================================
 
+string canonical_conditions_string(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &conditions)
+{
+    vector<string> atoms;
+    atoms.reserve(conditions.size());
+    for(const auto &condition:conditions)
+        atoms.emplace_back(condition.toString());
+    sort(atoms.begin(),atoms.end());     //unordered_set iteration order is not stable, so sort to get one string per set
+
+    string canonical;
+    for(const auto &atom:atoms)
+    {
+        canonical += atom;
+        canonical += ";";
+    }
+    return canonical;
+}
+
+//=====================================================================================================================
+
+// The action schemas of env in a stable order, each with its sorted preconditions and effects
+string canonical_schemas_string(Env* env)
+{
+    vector<string> schemas;
+    for(const auto &action:env->get_all_actions())
+    {
+        vector<string> conditions;
+        for(const auto &condition:action.get_preconditions())
+            conditions.push_back(condition.toString());
+        conditions.push_back("->");
+        for(const auto &condition:action.get_effects())
+            conditions.push_back(condition.toString());
+        sort(conditions.begin(),conditions.end());
+        string schema = action.toString();
+        for(const auto &condition:conditions)
+            schema += " " + condition;
+        schemas.push_back(schema);
+    }
+    sort(schemas.begin(),schemas.end());
+    string domain;
+    for(const auto &schema:schemas)
+        domain += schema + ";";
+    return domain;
+}
+
+//=====================================================================================================================
+
+// States of A* nodes and the keys used for duplicate detection. With a grounded task a node keeps its state packed by
+// the FiniteDomainTask, a few bytes instead of a set of conditions, and it is unpacked into atom ids when the node is
+// expanded. Keys are packed states too, canonical under object symmetries when they are in use. Lifted search has no
+// grounded task, so its nodes keep condition sets, keyed by their canonical string. Defined after ObjectSymmetries.
+class StateKeys
+{
+private:
+    const GroundedTask* task;
+    const FiniteDomainTask* fdr;
+    const ObjectSymmetries* symmetries;
+
+public:
+    StateKeys(const GroundedTask* task, const FiniteDomainTask* fdr, const ObjectSymmetries* symmetries)
+        : task(task),fdr(fdr),symmetries(symmetries)
+    {
+    }
+
+    bool packs_states() const
+    {
+        return this->fdr!=nullptr;
+    }
+
+    string key(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &state) const;
+    string key(vector<int> atoms) const;
+    string key(const Node &node) const;
+    string pack(const vector<int> &atoms) const;
+    vector<int> unpack(const Node &node) const;
+    vector<int> apply(const vector<int> &atoms, int action) const;
+};
+
+string search_state_key(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &state,
+                        const StateKeys &state_keys);
+
+//=====================================================================================================================
+
+// candidate_actions are the actions applicable in present_node that are to be expanded. present_atoms is the unpacked
+// state of present_node when it is packed. With count_unsatisfied_goals the successors get the number of goal
+// conditions they do not satisfy as hcost (goal_atoms are the goal of the grounded task), which orders the beam that
+// A* turns into when it runs out of memory.
 void expand_state(const Node &present_node,
+                  const vector<int> &present_atoms,
                   const vector<GroundedAction> &action_list,
-                  unordered_map<int,Node> &node_map,
-                  priority_queue<Node, vector<Node>, Node_Comp> &open,
+                  OpenList &open,
                   int &node_count,
-                  const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &goal_ground_conditions)
+                  const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &goal_ground_conditions,
+                  StateGcostMap &best_gcost,
+                  StateKeySet &closed,
+                  const vector<int> &candidate_actions,
+                  const StateKeys &state_keys,
+                  bool count_unsatisfied_goals,
+                  const vector<int> &goal_atoms)
 {
-    for(const auto &gaction:action_list)
+    for(int action_index:candidate_actions)
     {
+        const auto &gaction = action_list[action_index];
+//        cout<<gaction.toString()<<endl;
+        unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> new_grounded_conditions;
+        vector<int> new_atoms;
+        string state_key;
+        if(state_keys.packs_states())
+        {
+            new_atoms = state_keys.apply(present_atoms,action_index);
+            state_key = state_keys.key(new_atoms);
+        }
+        else
+        {
+            new_grounded_conditions = get_new_grounded_conditions(present_node.gc,gaction.get_effects());
+            state_key = search_state_key(new_grounded_conditions,state_keys);
+        }
+        search_stats.generations++;
 
-        auto preconds = gaction.get_preconditions();
-
-        if(!are_all_elements_present_in_collection(preconds,present_node.gc))
+        const double new_g_cost = present_node.gcost+1;
+        auto best = best_gcost.find(state_key);
+        if(best!=best_gcost.end() && best->second<=new_g_cost)
+        {
+            search_stats.duplicates++;
             continue;
-//        cout<<gaction.toString()<<endl;
-        auto new_grounded_conditions = get_new_grounded_conditions(present_node.gc,gaction.get_effects());
-        node_map.insert({node_count,Node{std::move(new_grounded_conditions),vector<int> {present_node.index_in_map},vector<GroundedAction> {gaction},present_node.gcost+1,0,node_count}});
-        auto new_h_cost = node_map.at(node_count).calculate_hcost(goal_ground_conditions);
-        node_map.at(node_count).set_hcost(new_h_cost);
-        open.push(node_map.at(node_count));
+        }
+        if(closed.erase(state_key))
+        {
+            search_stats.reopenings++;
+            memory_accountant.release(string_heap_bytes(state_key));
+        }
+        if(best==best_gcost.end())
+            memory_accountant.charge(string_heap_bytes(state_key));
+        best_gcost[state_key] = new_g_cost;
+
+        Node successor = state_keys.packs_states()
+            ? Node{{},vector<int> {present_node.index_in_map},{},new_g_cost,0,node_count}
+            : Node{std::move(new_grounded_conditions),vector<int> {present_node.index_in_map},vector<GroundedAction> {gaction},new_g_cost,0,node_count};
+        if(state_keys.packs_states())
+            successor.packed = state_keys.pack(new_atoms);
+        successor.action_index = action_index;
+        auto heuristic_start = chrono::steady_clock::now();
+        auto new_h_cost = successor.calculate_hcost(goal_ground_conditions);
+        if(count_unsatisfied_goals && state_keys.packs_states())
+        {
+            new_h_cost = 0;
+            for(int atom:goal_atoms)
+                new_h_cost += !binary_search(new_atoms.begin(),new_atoms.end(),atom);
+        }
+        else if(count_unsatisfied_goals)
+        {
+            new_h_cost = 0;
+            for(const auto &condition:goal_ground_conditions)
+                new_h_cost += !successor.gc.count(condition);
+        }
+        search_stats.heuristic_seconds += seconds_since(heuristic_start);
+        search_stats.heuristic_evaluations++;
+        successor.set_hcost(new_h_cost);
+        memory_accountant.charge(approximate_node_bytes(successor));
+        open.push(std::move(successor));     //It enters node_map when it is expanded
         node_count++;
     }
+    search_stats.open_peak = max(search_stats.open_peak,open.size());
 }
 
 //=====================================================================================================================
 
+// Packed nodes have no condition set to compare with start_gc; the walk stops at the start node, which has no parent.
 list<GroundedAction> back_track(int goal_map_index,
-                                const unordered_map<int,Node> &node_map,
+                                const NodeMap &node_map,
                                 list<GroundedAction> actions,
-                                const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &start_gc)
+                                const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &start_gc,
+                                const vector<GroundedAction> &action_list)
 {
-    cout<<"Starting backtracking"<<endl;
-    cout<<"Final goal index "<<goal_map_index<<endl;
-    while(!are_all_elements_present_in_collection(node_map.at(goal_map_index).gc,start_gc))
+    if(log_enabled(LOG_INFO))
+    {
+        cout<<"Starting backtracking"<<endl;
+        cout<<"Final goal index "<<goal_map_index<<endl;
+    }
+    auto at_start = [&](const Node &node)
+    {
+        return node.packed.empty() ? are_all_elements_present_in_collection(node.gc,start_gc) : node.neighbors.empty();
+    };
+    while(!at_start(node_map.at(goal_map_index)))
     {
         double g_min = INT_MAX;
         int best_neighbor_vector_index = -2; //Some impossible value initialization
@@ -1140,7 +1758,9 @@ list<GroundedAction> back_track(int goal_map_index,
                 best_neighbor_vector_index = i;
             }
         }
-        actions.emplace_back(node_map.at(goal_map_index).parent_gaction[best_neighbor_vector_index]);
+        const auto &node = node_map.at(goal_map_index);
+        actions.emplace_back(node.parent_gaction.empty() ? action_list[node.action_index]
+                                                         : node.parent_gaction[best_neighbor_vector_index]);
         goal_map_index = node_map.at(goal_map_index).neighbors[best_neighbor_vector_index];
     }
 
@@ -1150,73 +1770,5819 @@ list<GroundedAction> back_track(int goal_map_index,
 
 //=====================================================================================================================
 
-list<GroundedAction> planner(Env* env)
+// Search trace file layout: a TraceHeader, header.event_count TraceEvents, then header.action_count action names
+// each written as a uint32_t length followed by the characters. Timestamps are raw clock ticks, converted to seconds
+// with header.ticks_per_second.
+struct TraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;
+    double ticks_per_second;
+    uint64_t event_count;
+    uint64_t dropped_events;
+    uint64_t action_count;
+};
+
+struct TraceEvent
 {
+    uint64_t timestamp;
+    int32_t node_id;
+    int32_t parent_id;
+    int32_t action_id;
+    float gcost;
+    float hcost;
+    uint32_t padding;
+};
 
-    list<GroundedAction> actions;
-    priority_queue<Node, vector<Node>, Node_Comp> open;
-//    unordered_set<Node,Node_hasher> closed;           /// TODO  See how we are implementing closed list
-    unordered_map<int,Node> node_map;   //This serves as my map since it's an implicit directed graph
-    const auto action_list = get_all_possible_actions(env->get_all_actions(),env->get_symbols());
-    const auto start_gc = env->get_initial_conditions();
-    const auto goal_gc = env->get_goal_conditions();
-    int node_count = 0;
-    Node start_node{start_gc,0,node_count};
-    node_map.insert({node_count++,start_node});
-    open.push(start_node);
-    int goal_node = -1;
-    int loop_iteration_counter = 1;
-    while(!open.empty())
+const char trace_magic[8] = {'P','L','T','R','A','C','E','1'};
+
+//=====================================================================================================================
+
+inline uint64_t trace_clock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+//=====================================================================================================================
+
+// Records expansions into a single producer / single consumer ring buffer. The search thread only copies the event into
+// the ring and publishes it with one release store; a background thread drains the ring to disk. When the flusher falls
+// behind the event is dropped and counted instead of stalling the search.
+class TraceRecorder
+{
+private:
+    static const size_t capacity = 1 << 16;
+    vector<TraceEvent> ring;
+    alignas(64) atomic<uint64_t> head{0};       //Next slot the search writes, only stored by the search thread
+    alignas(64) atomic<uint64_t> tail{0};       //Next slot to flush, only stored by the flusher thread
+    alignas(64) atomic<bool> running{false};
+    uint64_t dropped = 0;
+    uint64_t written = 0;
+    FILE* file = nullptr;
+    thread flusher;
+    vector<string> action_names;
+    uint64_t start_ticks = 0;
+    chrono::steady_clock::time_point start_time;
+
+    void flush_available()
     {
-//        cout<<"Loop iteration counter "<<loop_iteration_counter<<endl;
-        cout<<"--------------------------"<<endl;
-        const auto node_to_expand = open.top();
-        node_to_expand.print_node();
-        open.pop();
-        if(are_all_elements_present_in_collection(goal_gc,node_to_expand.gc))
-            {
-                cout<<"Goal has been found"<<endl;
-                goal_node = node_to_expand.index_in_map;
-                break;
-            }
-        expand_state(node_to_expand,action_list,node_map,open,node_count,goal_gc);
-        loop_iteration_counter++;
+        uint64_t t = this->tail.load(memory_order_relaxed);
+        uint64_t h = this->head.load(memory_order_acquire);
+        while(t<h)
+        {
+            size_t begin = t & (capacity-1);
+            size_t count = min<uint64_t>(h-t,capacity-begin);
+            fwrite(&this->ring[begin],sizeof(TraceEvent),count,this->file);
+            t += count;
+            this->written += count;
+        }
+        this->tail.store(t,memory_order_release);
     }
 
-    if(goal_node!=-1)
+    void flush_loop()
     {
-        cout<<"PATH FOUND"<<endl;
-        actions = back_track(goal_node,node_map,std::move(actions),start_gc);
+        while(this->running.load(memory_order_acquire))
+        {
+            this->flush_available();
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        this->flush_available();
     }
-    else
-        cout<<"PATH NOT FOUND"<<endl;
-
-    return std::move(actions);
 
-    /// Use the index_in_map to backtrack. Keep selecting parents with lower gcost while backtracking
-}
+public:
+    ~TraceRecorder()
+    {
+        this->close();
+    }
 
-int main(int argc, char* argv[])
-{
-    // DO NOT CHANGE THIS FUNCTION
-    char* filename = (char*)("example.txt");
-    if (argc > 1)
-        filename = argv[1];
+    bool is_open() const
+    {
+        return this->file!=nullptr;
+    }
 
-    cout << "Environment: " << filename << endl << endl;
-    Env* env = create_env(filename);
-    if (print_status)
+    bool open(const string &path, const vector<GroundedAction> &action_list)
     {
-        cout << *env;
+        this->file = fopen(path.c_str(),"wb");
+        if(!this->file)
+            return false;
+        this->ring.resize(capacity);
+        TraceHeader header{};
+        memcpy(header.magic,trace_magic,sizeof(header.magic));
+        fwrite(&header,sizeof(header),1,this->file);       //Rewritten with the final counts on close
+        this->start_ticks = trace_clock();
+        this->start_time = chrono::steady_clock::now();
+        this->action_names.clear();
+        for(const auto &gaction:action_list)
+            this->action_names.push_back(gaction.toString());
+        this->running.store(true,memory_order_release);
+        this->flusher = thread(&TraceRecorder::flush_loop,this);
+        return true;
     }
 
-    list<GroundedAction> actions = planner(env);
+    inline void record(int node_id, int parent_id, int action_id, double gcost, double hcost)
+    {
+        uint64_t h = this->head.load(memory_order_relaxed);
+        if(h-this->tail.load(memory_order_acquire)>=capacity)
+        {
+            this->dropped++;
+            return;
+        }
+        TraceEvent &event = this->ring[h & (capacity-1)];
+        event.timestamp = trace_clock();
+        event.node_id = node_id;
+        event.parent_id = parent_id;
+        event.action_id = action_id;
+        event.gcost = (float)gcost;
+        event.hcost = (float)hcost;
+        event.padding = 0;
+        this->head.store(h+1,memory_order_release);
+    }
 
-    cout << "\nPlan: " << endl;
-    for (GroundedAction gac : actions)
+    void close()
     {
-        cout << gac << endl;
+        if(!this->file)
+            return;
+        this->running.store(false,memory_order_release);
+        this->flusher.join();
+
+        for(const auto &name:this->action_names)
+        {
+            uint32_t length = name.size();
+            fwrite(&length,sizeof(length),1,this->file);
+            fwrite(name.data(),1,length,this->file);
+        }
+
+        TraceHeader header{};
+        memcpy(header.magic,trace_magic,sizeof(header.magic));
+        header.version = 1;
+        header.event_size = sizeof(TraceEvent);
+        double elapsed = seconds_since(this->start_time);
+        uint64_t elapsed_ticks = trace_clock()-this->start_ticks;
+        header.ticks_per_second = elapsed>0 ? elapsed_ticks/elapsed : 1e9;
+        header.event_count = this->written;
+        header.dropped_events = this->dropped;
+        header.action_count = this->action_names.size();
+        fseek(this->file,0,SEEK_SET);
+        fwrite(&header,sizeof(header),1,this->file);
+        fclose(this->file);
+        this->file = nullptr;
     }
+};
 
-    return 0;
-}
\ No newline at end of file
+//=====================================================================================================================
+
+bool trace_this_query()
+{
+    if(trace_file=="")
+        return false;
+    if(trace_sample_rate>=1.0)
+        return true;
+    static thread_local mt19937 sampler(random_device{}());
+    return uniform_real_distribution<double>(0.0,1.0)(sampler)<trace_sample_rate;
+}
+
+//=====================================================================================================================
+
+// Search modes that record PLANNER_TRACE. The others run without a trace, and planner() and portfolio_planner warn.
+bool search_mode_traces(int mode)
+{
+    return mode==SEARCH_ASTAR || mode==SEARCH_REGRESSION || mode==SEARCH_BIDIRECTIONAL || mode==SEARCH_BFWS
+           || mode==SEARCH_PORTFOLIO;
+}
+
+//=====================================================================================================================
+
+// A cached plan answers a query only when the domain (schemas and symbols) and the initial and goal conditions are
+// the same and it was found by a search configuration that may answer it, see plan_cache_configuration.
+string plan_cache_key(Env* env, const string &configuration)
+{
+    char schemas[32];
+    snprintf(schemas,sizeof(schemas),"%016llx",(unsigned long long)std::hash<string>{}(canonical_schemas_string(env)));
+    auto symbol_set = env->get_symbols();
+    vector<string> symbols(symbol_set.begin(),symbol_set.end());
+    sort(symbols.begin(),symbols.end());
+    string key = "C:" + configuration + "D:" + schemas + ";O:";
+    for(const auto &symbol:symbols)
+        key += symbol + ",";
+    return key + ";I:" + canonical_conditions_string(env->get_initial_conditions())
+               + "G:" + canonical_conditions_string(env->get_goal_conditions());
+}
+
+//=====================================================================================================================
+
+bool ground_action_from_schema(const Action &action,
+                               const list<string> &arg_values,
+                               GroundedAction &grounded_action)
+{
+    auto args = action.get_args();
+    if(args.size()!=arg_values.size())
+        return false;
+
+    unordered_map<string,string> placeholder_to_symbol_map;
+    auto it_value = arg_values.begin();
+    for(auto it_args = args.begin();it_args!=args.end();it_args++,it_value++)
+    {
+        placeholder_to_symbol_map[*it_args] = *it_value;
+    }
+    grounded_action = GroundedAction{action.get_name(),
+                                     arg_values,
+                                     get_grounded_conditions(action.get_preconditions(),placeholder_to_symbol_map),
+                                     get_grounded_conditions(action.get_effects(),placeholder_to_symbol_map)};
+    return true;
+}
+
+//=====================================================================================================================
+
+bool validate_plan(Env* env, const list<GroundedAction> &plan)
+{
+    // Forward simulation of the plan from the initial conditions. The actions are re-grounded from the schemas in env
+    // so that a plan cached against a different domain definition is rejected.
+    auto state = env->get_initial_conditions();
+    for(const auto &step:plan)
+    {
+        GroundedAction gaction{step.get_name(),step.get_arg_values()};
+        try
+        {
+            if(!ground_action_from_schema(env->get_action(step.get_name()),step.get_arg_values(),gaction))
+                return false;
+        }
+        catch(const runtime_error &)
+        {
+            return false;
+        }
+        if(!are_all_elements_present_in_collection(gaction.get_preconditions(),state))
+            return false;
+        state = get_new_grounded_conditions(std::move(state),gaction.get_effects());
+    }
+    return are_all_elements_present_in_collection(env->get_goal_conditions(),state);
+}
+
+//=====================================================================================================================
+
+class PlanCache
+{
+private:
+    struct Entry
+    {
+        size_t hash;
+        string key;
+        list<GroundedAction> plan;
+    };
+
+    size_t capacity;
+    string directory;
+    list<Entry> entries;     //Most recently used entry is at the front
+    unordered_map<size_t, list<Entry>::iterator> index;
+
+    string file_for(size_t hash) const
+    {
+        char name[32];
+        snprintf(name,sizeof(name),"%016llx.plan",(unsigned long long)hash);
+        return this->directory + "/" + name;
+    }
+
+    void insert_in_memory(size_t hash, const string &key, const list<GroundedAction> &plan)
+    {
+        if(this->capacity==0)
+            return;
+        auto found = this->index.find(hash);
+        if(found!=this->index.end())
+        {
+            this->entries.erase(found->second);
+            this->index.erase(found);
+        }
+        this->entries.push_front(Entry{hash,key,plan});
+        this->index[hash] = this->entries.begin();
+        while(this->entries.size()>this->capacity)
+        {
+            this->index.erase(this->entries.back().hash);
+            this->entries.pop_back();
+        }
+    }
+
+    void evict(size_t hash)
+    {
+        auto found = this->index.find(hash);
+        if(found!=this->index.end())
+        {
+            this->entries.erase(found->second);
+            this->index.erase(found);
+        }
+        remove(this->file_for(hash).c_str());
+    }
+
+    bool read_from_disk(size_t hash, const string &key, list<GroundedAction> &plan) const
+    {
+        ifstream plan_file(this->file_for(hash));
+        if(!plan_file.is_open())
+            return false;
+
+        string line;
+        if(!getline(plan_file,line) || line!="key "+key)     //Hash collision or a stale file
+            return false;
+
+        regex actionLineRegex("([a-zA-Z0-9_]+)\\(([a-zA-Z0-9_,]*)\\)");
+        plan.clear();
+        while(getline(plan_file,line))
+        {
+            if(line=="")
+                continue;
+            smatch results;
+            if(!regex_match(line,results,actionLineRegex))
+                return false;
+            plan.emplace_back(GroundedAction{results[1].str(),parse_symbols(results[2].str())});
+        }
+        return true;
+    }
+
+    void write_to_disk(size_t hash, const string &key, const list<GroundedAction> &plan) const
+    {
+        mkdir(this->directory.c_str(),0755);
+        string file_name = this->file_for(hash);
+        string temp_name = file_name + ".tmp";
+        {
+            ofstream plan_file(temp_name);
+            if(!plan_file.is_open())
+                return;
+            plan_file<<"key "<<key<<"\n";
+            for(const auto &gaction:plan)
+                plan_file<<gaction.toString()<<"\n";
+        }
+        rename(temp_name.c_str(),file_name.c_str());     //Readers never see a half written plan
+    }
+
+public:
+    PlanCache(size_t capacity, string directory): capacity{capacity},directory{directory}
+    {
+    }
+
+    bool lookup(const string &key, Env* env, list<GroundedAction> &plan)
+    {
+        size_t hash = std::hash<string>{}(key);
+        auto found = this->index.find(hash);
+        if(found!=this->index.end() && found->second->key==key)
+        {
+            this->entries.splice(this->entries.begin(),this->entries,found->second);
+            plan = found->second->plan;
+        }
+        else if(!this->read_from_disk(hash,key,plan))
+        {
+            return false;
+        }
+
+        if(!validate_plan(env,plan))
+        {
+            this->evict(hash);
+            return false;
+        }
+
+        // Hand back fully grounded actions, the disk tier only stores names and arguments
+        for(auto &gaction:plan)
+            ground_action_from_schema(env->get_action(gaction.get_name()),gaction.get_arg_values(),gaction);
+        this->insert_in_memory(hash,key,plan);
+        return true;
+    }
+
+    void store(const string &key, const list<GroundedAction> &plan)
+    {
+        size_t hash = std::hash<string>{}(key);
+        this->insert_in_memory(hash,key,plan);
+        this->write_to_disk(hash,key,plan);
+    }
+};
+
+//=====================================================================================================================
+
+PlanCache& get_plan_cache()
+{
+    static PlanCache plan_cache{plan_cache_capacity,plan_cache_dir};
+    return plan_cache;
+}
+
+//=====================================================================================================================
+
+// Mutex invariants found by invariant synthesis over the lifted action schemas, in the style of Helmert's translator.
+// An invariant is a set of parts, at most one per predicate. The arguments of an atom at the fixed positions of its
+// part are the parameters of the invariant and the other arguments are counted. The invariant states that for every
+// value of its parameters at most one matching atom is true: On with fixed position 0 says a block is on at most one
+// thing.
+struct InvariantPart
+{
+    string predicate;
+    vector<int> fixed_positions;
+
+    bool operator<(const InvariantPart &other) const
+    {
+        return make_pair(this->predicate,this->fixed_positions) < make_pair(other.predicate,other.fixed_positions);
+    }
+};
+
+struct Invariant
+{
+    vector<InvariantPart> parts;    //Sorted
+
+    const InvariantPart* part_for(const string &predicate) const
+    {
+        for(const auto &part:this->parts)
+            if(part.predicate==predicate)
+                return &part;
+        return nullptr;
+    }
+
+    bool operator<(const Invariant &other) const
+    {
+        return this->parts < other.parts;
+    }
+
+    string to_string() const
+    {
+        string text;
+        for(const auto &part:this->parts)
+        {
+            text += (text.empty() ? "" : " ") + part.predicate + "[";
+            for(size_t i=0;i<part.fixed_positions.size();i++)
+                text += (i ? "," : "") + std::to_string(part.fixed_positions[i]);
+            text += "]";
+        }
+        return text;
+    }
+};
+
+//=====================================================================================================================
+
+class InvariantSynthesis
+{
+private:
+    struct SchemaAtom
+    {
+        string predicate;
+        vector<string> args;
+    };
+
+    struct Schema
+    {
+        vector<SchemaAtom> preconditions;
+        vector<SchemaAtom> adds;
+        vector<SchemaAtom> deletes;
+    };
+
+    static const size_t max_candidates = 10000;
+    vector<Schema> schemas;
+    vector<unordered_set<string>> variables_of;     //Schema -> its parameter names
+    map<string,int> fluent_arities;                 //Predicates that some action adds or deletes
+
+    static vector<string> fixed_arguments(const InvariantPart &part, const SchemaAtom &atom)
+    {
+        vector<string> args;
+        for(int position:part.fixed_positions)
+            args.push_back(atom.args[position]);
+        return args;
+    }
+
+    static bool is_precondition(const Schema &schema, const SchemaAtom &atom)
+    {
+        for(const auto &precondition:schema.preconditions)
+            if(precondition.predicate==atom.predicate && precondition.args==atom.args)
+                return true;
+        return false;
+    }
+
+    // Two invariant instances can be the same unless some parameter is bound to two different constants
+    static bool may_coincide(const vector<string> &a, const vector<string> &b, const unordered_set<string> &variables)
+    {
+        for(size_t i=0;i<a.size();i++)
+            if(a[i]!=b[i] && !variables.count(a[i]) && !variables.count(b[i]))
+                return false;
+        return true;
+    }
+
+    // Returns -1 when the schema keeps the invariant, the index of an unbalanced add effect when it may add an atom
+    // without deleting one of the same instance, or -2 when it can add two atoms of one instance.
+    int check(const Invariant &invariant, const Schema &schema, const unordered_set<string> &variables) const
+    {
+        vector<pair<int,vector<string>>> threats;
+        for(int i=0;i<(int)schema.adds.size();i++)
+            if(auto part = invariant.part_for(schema.adds[i].predicate))
+                threats.emplace_back(i,fixed_arguments(*part,schema.adds[i]));
+        for(size_t i=0;i<threats.size();i++)
+            for(size_t j=i+1;j<threats.size();j++)
+                if(may_coincide(threats[i].second,threats[j].second,variables))
+                    return -2;
+
+        for(const auto &threat:threats)
+        {
+            const auto &added = schema.adds[threat.first];
+            if(is_precondition(schema,added))
+                continue;       //Already true, so nothing is added
+            bool balanced = false;
+            for(const auto &deleted:schema.deletes)
+            {
+                auto part = invariant.part_for(deleted.predicate);
+                balanced = part && fixed_arguments(*part,deleted)==threat.second && is_precondition(schema,deleted);
+                if(balanced)
+                    break;
+            }
+            if(!balanced)
+                return threat.first;
+        }
+        return -1;
+    }
+
+public:
+    InvariantSynthesis(Env* env)
+    {
+        for(const auto &action:env->get_all_actions())
+        {
+            Schema schema;
+            for(const auto &precondition:action.get_preconditions())
+                if(precondition.get_truth())
+                {
+                    auto args = precondition.get_args();
+                    schema.preconditions.push_back(SchemaAtom{precondition.get_predicate(),vector<string>(args.begin(),args.end())});
+                }
+            for(const auto &effect:action.get_effects())
+            {
+                auto args = effect.get_args();
+                SchemaAtom atom{effect.get_predicate(),vector<string>(args.begin(),args.end())};
+                this->fluent_arities[atom.predicate] = atom.args.size();
+                (effect.get_truth() ? schema.adds : schema.deletes).push_back(atom);
+            }
+            this->schemas.push_back(schema);
+            auto args = action.get_args();
+            this->variables_of.emplace_back(args.begin(),args.end());
+        }
+    }
+
+    // Starts from one counted argument per fluent predicate and, when a schema adds an atom without deleting one of
+    // the same instance, tries to repair the candidate with the predicate of a deleted precondition.
+    vector<Invariant> synthesize() const
+    {
+        vector<Invariant> queue;
+        set<Invariant> seen;
+        for(const auto &fluent:this->fluent_arities)
+        {
+            for(int counted=0;counted<fluent.second;counted++)
+            {
+                InvariantPart part{fluent.first,{}};
+                for(int position=0;position<fluent.second;position++)
+                    if(position!=counted)
+                        part.fixed_positions.push_back(position);
+                Invariant candidate{{part}};
+                if(seen.insert(candidate).second)
+                    queue.push_back(candidate);
+            }
+        }
+
+        vector<Invariant> invariants;
+        for(size_t next=0;next<queue.size();next++)
+        {
+            const Invariant candidate = queue[next];
+            bool valid = true;
+            for(size_t s=0;s<this->schemas.size() && valid;s++)
+            {
+                const auto &schema = this->schemas[s];
+                int unbalanced = this->check(candidate,schema,this->variables_of[s]);
+                if(unbalanced==-1)
+                    continue;
+                valid = false;
+                if(unbalanced<0 || seen.size()>=max_candidates)
+                    break;
+
+                const auto &added = schema.adds[unbalanced];
+                auto parameters = fixed_arguments(*candidate.part_for(added.predicate),added);
+                for(const auto &deleted:schema.deletes)
+                {
+                    if(candidate.part_for(deleted.predicate) || !is_precondition(schema,deleted))
+                        continue;
+                    InvariantPart part{deleted.predicate,{}};
+                    for(const auto &parameter:parameters)
+                    {
+                        auto found = find(deleted.args.begin(),deleted.args.end(),parameter);
+                        if(found==deleted.args.end())
+                            break;
+                        part.fixed_positions.push_back(found-deleted.args.begin());
+                    }
+                    if(part.fixed_positions.size()!=parameters.size())
+                        continue;
+                    Invariant refined = candidate;
+                    refined.parts.push_back(part);
+                    sort(refined.parts.begin(),refined.parts.end());
+                    if(seen.insert(refined).second)
+                        queue.push_back(refined);
+                }
+            }
+            if(valid)
+                invariants.push_back(candidate);
+        }
+        return invariants;
+    }
+};
+
+//=====================================================================================================================
+
+vector<Invariant> synthesize_invariants(Env* env)
+{
+    auto invariants = InvariantSynthesis(env).synthesize();
+    if(log_enabled(LOG_INFO))
+        for(const auto &invariant:invariants)
+            cout<<"Mutex invariant: "<<invariant.to_string()<<endl;
+    return invariants;
+}
+
+//=====================================================================================================================
+
+// Integer view of the grounded task used by the search engines below: every grounded condition gets an atom id, states
+// are sorted vectors of the ids of the atoms that hold, and actions are sorted precondition, add and delete id lists.
+// Action ids are indices into the grounded action list, so they line up with the action_list of astar_planner.
+struct AtomStateHasher
+{
+    size_t operator()(const vector<int> &state) const
+    {
+        size_t seed = state.size();
+        for(int atom:state)
+            seed ^= (size_t)atom + 0x9e3779b9 + (seed<<6) + (seed>>2);
+        return seed;
+    }
+};
+
+//=====================================================================================================================
+
+struct GroundedTask
+{
+    vector<GroundedCondition> atoms;
+    unordered_map<GroundedCondition, int, GroundedConditionHasher, GroundedConditionComparator> atom_ids;
+    vector<GroundedAction> actions;
+    vector<vector<int>> preconditions;
+    vector<vector<int>> add_effects;
+    vector<vector<int>> delete_effects;
+    vector<int> initial_state;
+    vector<int> goal;
+    vector<Invariant> invariants;
+    vector<vector<char>> h2_reachable;      //Atom pairs that may hold together, empty when compute_h2_mutexes did not run
+
+    int intern(const GroundedCondition &atom)
+    {
+        auto found = atom_ids.find(atom);
+        if(found!=atom_ids.end())
+            return found->second;
+        atoms.push_back(atom);
+        atom_ids.insert({atom,(int)atoms.size()-1});
+        return atoms.size()-1;
+    }
+
+    vector<int> intern_all(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &conditions)
+    {
+        vector<int> ids;
+        for(const auto &condition:conditions)
+            ids.push_back(intern(condition));
+        sort(ids.begin(),ids.end());
+        return ids;
+    }
+
+    vector<int> state_ids(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &conditions) const
+    {
+        vector<int> ids;
+        for(const auto &condition:conditions)
+            ids.push_back(atom_ids.at(condition));
+        sort(ids.begin(),ids.end());
+        return ids;
+    }
+
+    int add_action(const GroundedAction &gaction)
+    {
+        // A negative precondition is interned as its own atom, which no state ever contains. This keeps the
+        // semantics of are_all_elements_present_in_collection, where such an action is never applicable.
+        preconditions.push_back(intern_all(gaction.get_preconditions()));
+        vector<int> adds, deletes;
+        for(auto effect:gaction.get_effects())
+        {
+            if(effect.get_truth())
+                adds.push_back(intern(effect));
+            else
+            {
+                effect.set_truth(true);
+                deletes.push_back(intern(effect));
+            }
+        }
+        sort(adds.begin(),adds.end());
+        sort(deletes.begin(),deletes.end());
+        add_effects.push_back(adds);
+        delete_effects.push_back(deletes);
+        actions.push_back(gaction);
+        return actions.size()-1;
+    }
+
+    bool is_applicable(const vector<int> &state, int action) const
+    {
+        return includes(state.begin(),state.end(),preconditions[action].begin(),preconditions[action].end());
+    }
+
+    vector<int> apply(const vector<int> &state, int action) const
+    {
+        vector<int> remaining, successor;
+        set_difference(state.begin(),state.end(),delete_effects[action].begin(),delete_effects[action].end(),
+                       back_inserter(remaining));
+        set_union(remaining.begin(),remaining.end(),add_effects[action].begin(),add_effects[action].end(),
+                  back_inserter(successor));
+        return successor;
+    }
+
+    // True when the atoms contain an unreachable atom or an h^2 mutex pair, so no reachable state satisfies them
+    bool has_mutex(const vector<int> &atoms) const
+    {
+        if(h2_reachable.empty())
+            return false;
+        for(size_t i=0;i<atoms.size();i++)
+            for(size_t j=i;j<atoms.size();j++)
+                if(!h2_reachable[atoms[i]][atoms[j]])
+                    return true;
+        return false;
+    }
+
+    bool satisfies(const vector<int> &state, const vector<int> &condition) const
+    {
+        return includes(state.begin(),state.end(),condition.begin(),condition.end());
+    }
+
+    list<GroundedAction> to_plan(const vector<int> &action_ids) const
+    {
+        list<GroundedAction> plan;
+        for(int action:action_ids)
+            plan.push_back(actions[action]);
+        return plan;
+    }
+};
+
+//=====================================================================================================================
+
+// h^2 reachability (Haslum and Geffner): a fixpoint over pairs of atoms that may hold together in a reachable state.
+// An applicable action makes its add effects reachable together, and each add effect reachable together with every
+// atom that it does not delete and that is reachable together with all of its preconditions. Pairs that never become
+// reachable are mutex. Actions with an unreachable precondition or a mutex pair of preconditions are removed from the
+// task. The analysis costs about actions * atoms per iteration and is skipped above h2_work_budget, in which case
+// h2_reachable_pairs returns an empty table.
+vector<vector<char>> h2_reachable_pairs(const GroundedTask &task, vector<char> &applicable)
+{
+    const size_t n = task.atoms.size();
+    applicable.assign(task.actions.size(),0);
+    if((double)n*task.actions.size()>h2_work_budget)
+        return vector<vector<char>>();
+
+    vector<vector<char>> reachable(n,vector<char>(n,0));
+    for(int p:task.initial_state)
+        for(int q:task.initial_state)
+            reachable[p][q] = 1;
+
+    auto jointly_reachable = [&](int atom, const vector<int> &atoms)
+    {
+        for(int other:atoms)
+            if(!reachable[atom][other])
+                return false;
+        return true;
+    };
+
+    bool changed = true;
+    while(changed)
+    {
+        changed = false;
+        auto mark = [&](int p, int q)
+        {
+            if(!reachable[p][q])
+            {
+                reachable[p][q] = reachable[q][p] = 1;
+                changed = true;
+            }
+        };
+        for(size_t a=0;a<task.actions.size();a++)
+        {
+            const auto &pre = task.preconditions[a];
+            if(!applicable[a])
+            {
+                bool pre_reachable = true;
+                for(int p:pre)
+                    pre_reachable = pre_reachable && jointly_reachable(p,pre);
+                if(!pre_reachable)
+                    continue;
+                applicable[a] = 1;
+            }
+            for(int p:task.add_effects[a])
+                for(int q:task.add_effects[a])
+                    mark(p,q);
+            for(int q=0;q<(int)n;q++)
+            {
+                if(!reachable[q][q] || binary_search(task.delete_effects[a].begin(),task.delete_effects[a].end(),q)
+                   || !jointly_reachable(q,pre))
+                    continue;
+                for(int p:task.add_effects[a])
+                    mark(p,q);
+            }
+        }
+    }
+    return reachable;
+}
+
+void compute_h2_mutexes(GroundedTask &task)
+{
+    const size_t n = task.atoms.size();
+    vector<char> applicable;
+    auto reachable = h2_reachable_pairs(task,applicable);
+    if(reachable.empty())
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"Skipping h^2 analysis of "<<task.actions.size()<<" actions over "<<n<<" atoms"<<endl;
+        return;
+    }
+
+    GroundedTask pruned;
+    pruned.atoms = std::move(task.atoms);
+    pruned.atom_ids = std::move(task.atom_ids);
+    pruned.initial_state = std::move(task.initial_state);
+    pruned.goal = std::move(task.goal);
+    pruned.invariants = std::move(task.invariants);
+    for(size_t a=0;a<task.actions.size();a++)
+    {
+        if(!applicable[a])
+            continue;
+        pruned.actions.push_back(std::move(task.actions[a]));
+        pruned.preconditions.push_back(std::move(task.preconditions[a]));
+        pruned.add_effects.push_back(std::move(task.add_effects[a]));
+        pruned.delete_effects.push_back(std::move(task.delete_effects[a]));
+    }
+    search_stats.h2_pruned_actions = task.actions.size()-pruned.actions.size();
+    search_stats.h2_mutex_pairs = 0;
+    for(size_t p=0;p<n;p++)
+        for(size_t q=p+1;q<n;q++)
+            search_stats.h2_mutex_pairs += reachable[p][p] && reachable[q][q] && !reachable[p][q];
+    pruned.h2_reachable = std::move(reachable);
+    task = std::move(pruned);
+    if(log_enabled(LOG_INFO))
+        cout<<"h^2 analysis: "<<search_stats.h2_mutex_pairs<<" mutex pairs, "<<search_stats.h2_pruned_actions
+            <<" unreachable actions removed"<<endl;
+}
+
+//=====================================================================================================================
+
+// A macro-operator: a sequence of schema applications whose arguments are macro parameters (?0, ?1, ...) or constants
+// of the domain, compiled into one Action with the combined preconditions and effects of the sequence. Macros are only
+// grounded with distinct objects that are not constants of the macro, so that two of its conditions refer to the same
+// atom exactly when they are written the same way and the compiled action behaves like the sequence.
+struct MacroSchema
+{
+    vector<pair<string,list<string>>> steps;
+    Action action;
+    int support;        //Occurrences in the plan corpus when the macro was mined
+};
+
+// Macros of the domain being solved, loaded by planner() and grounded by ground_task
+vector<MacroSchema> active_macros;
+
+//=====================================================================================================================
+
+// Symbols that the schemas use as constants, such as Table in MoveToTable(b,x)
+unordered_set<string> schema_constants(Env* env)
+{
+    unordered_set<string> constants;
+    for(const auto &action:env->get_all_actions())
+    {
+        auto args = action.get_args();
+        unordered_set<string> parameters(args.begin(),args.end());
+        for(const auto &conditions:{action.get_preconditions(),action.get_effects()})
+            for(const auto &condition:conditions)
+                for(const auto &arg:condition.get_args())
+                    if(!parameters.count(arg))
+                        constants.insert(arg);
+    }
+    return constants;
+}
+
+//=====================================================================================================================
+
+// Chains the schemas of the steps: a precondition that an earlier step adds is dropped, one that an earlier step
+// deletes makes the sequence inapplicable, and later effects override earlier ones. Returns false when the sequence
+// can never be applied, uses an unknown schema or changes nothing, and otherwise appends the macro to macros.
+bool compile_macro(Env* env, const string &name, const vector<pair<string,list<string>>> &steps, int support,
+                   vector<MacroSchema> &macros)
+{
+    unordered_set<Condition, ConditionHasher, ConditionComparator> preconditions;
+    unordered_set<Condition, ConditionHasher, ConditionComparator> added;
+    unordered_set<Condition, ConditionHasher, ConditionComparator> deleted;     //Stored with truth true
+    list<string> parameters;
+    unordered_set<string> seen_parameters;
+    for(const auto &step:steps)
+    {
+        Action schema = env->get_action(step.first);
+        auto schema_args = schema.get_args();
+        if(schema_args.size()!=step.second.size())
+            return false;
+        unordered_map<string,string> substitution;
+        auto it_value = step.second.begin();
+        for(auto it_args = schema_args.begin();it_args!=schema_args.end();it_args++,it_value++)
+        {
+            substitution[*it_args] = *it_value;
+            if(it_value->compare(0,1,"?")==0 && seen_parameters.insert(*it_value).second)
+                parameters.push_back(*it_value);
+        }
+        auto substitute = [&](const Condition &condition, bool truth)
+        {
+            list<string> args;
+            for(const auto &arg:condition.get_args())
+                args.push_back(substitution.count(arg) ? substitution[arg] : arg);
+            return Condition(condition.get_predicate(),args,truth);
+        };
+
+        for(const auto &precondition:schema.get_preconditions())
+        {
+            auto atom = substitute(precondition,true);
+            if(deleted.count(atom))
+                return false;
+            if(!added.count(atom))
+                preconditions.insert(atom);
+        }
+        for(const auto &effect:schema.get_effects())
+        {
+            auto atom = substitute(effect,true);
+            if(effect.get_truth())
+            {
+                added.insert(atom);
+                deleted.erase(atom);
+            }
+            else
+            {
+                deleted.insert(atom);
+                added.erase(atom);
+            }
+        }
+    }
+
+    unordered_set<Condition, ConditionHasher, ConditionComparator> effects;
+    for(const auto &atom:added)
+        if(!preconditions.count(atom))
+            effects.insert(atom);
+    for(const auto &atom:deleted)
+        effects.insert(Condition(atom.get_predicate(),atom.get_args(),false));
+    if(effects.empty())
+        return false;
+    macros.push_back(MacroSchema{steps,Action(name,parameters,preconditions,effects),support});
+    return true;
+}
+
+//=====================================================================================================================
+
+// Ground instances of the active macros. An instance that binds a parameter to one of the constants of its macro is
+// left out, see MacroSchema.
+vector<GroundedAction> ground_macros(const unordered_set<string> &symbols)
+{
+    unordered_set<Action, ActionHasher, ActionComparator> schemas;
+    unordered_map<string,unordered_set<string>> constants;
+    for(const auto &macro:active_macros)
+    {
+        schemas.insert(macro.action);
+        auto parameters = macro.action.get_args();
+        unordered_set<string> parameter_set(parameters.begin(),parameters.end());
+        for(const auto &conditions:{macro.action.get_preconditions(),macro.action.get_effects()})
+            for(const auto &condition:conditions)
+                for(const auto &arg:condition.get_args())
+                    if(!parameter_set.count(arg))
+                        constants[macro.action.get_name()].insert(arg);
+    }
+
+    vector<GroundedAction> macro_actions;
+    for(auto &gaction:get_all_possible_actions(schemas,symbols))
+    {
+        const auto &macro_constants = constants[gaction.get_name()];
+        bool binds_constant = false;
+        for(const auto &value:gaction.get_arg_values())
+            binds_constant = binds_constant || macro_constants.count(value);
+        if(!binds_constant)
+            macro_actions.push_back(std::move(gaction));
+    }
+    return macro_actions;
+}
+
+//=====================================================================================================================
+
+// Replaces every macro action of a plan by the schema applications it stands for
+list<GroundedAction> expand_macros(Env* env, const list<GroundedAction> &plan)
+{
+    unordered_map<string,const MacroSchema*> macros;
+    for(const auto &macro:active_macros)
+        macros[macro.action.get_name()] = &macro;
+
+    list<GroundedAction> expanded;
+    for(const auto &gaction:plan)
+    {
+        auto found = macros.find(gaction.get_name());
+        if(found==macros.end())
+        {
+            expanded.push_back(gaction);
+            continue;
+        }
+        search_stats.macro_plan_steps++;
+        unordered_map<string,string> binding;
+        auto parameters = found->second->action.get_args();
+        auto arg_values = gaction.get_arg_values();
+        auto it_value = arg_values.begin();
+        for(auto it_parameter = parameters.begin();it_parameter!=parameters.end();it_parameter++,it_value++)
+            binding[*it_parameter] = *it_value;
+        for(const auto &step:found->second->steps)
+        {
+            list<string> values;
+            for(const auto &arg:step.second)
+                values.push_back(binding.count(arg) ? binding[arg] : arg);
+            GroundedAction primitive{step.first,values};
+            ground_action_from_schema(env->get_action(step.first),values,primitive);
+            expanded.push_back(std::move(primitive));
+        }
+    }
+    return expanded;
+}
+
+//=====================================================================================================================
+
+// Macros are kept per domain: the plan corpus and the mined macros of a domain live in macro_dir under a hash of its
+// schemas, so a changed domain starts over instead of reusing macros that no longer compile.
+string macro_file(Env* env, const string &extension)
+{
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx",(unsigned long long)std::hash<string>{}(canonical_schemas_string(env)));
+    return macro_dir + "/" + name + extension;
+}
+
+//=====================================================================================================================
+
+// Reads a line of actions written as Name(arg,arg) separated by spaces
+bool parse_action_sequence(const string &line, vector<pair<string,list<string>>> &steps)
+{
+    regex actionRegex("([a-zA-Z0-9_]+)\\(([^()\\s]*)\\)");
+    steps.clear();
+    istringstream tokens(line);
+    string token;
+    while(tokens>>token)
+    {
+        smatch results;
+        if(!regex_match(token,results,actionRegex))
+            return false;
+        steps.push_back({results[1].str(),parse_symbols(results[2].str())});
+    }
+    return !steps.empty();
+}
+
+string action_sequence_string(const vector<pair<string,list<string>>> &steps)
+{
+    string line;
+    for(const auto &step:steps)
+    {
+        if(!line.empty())
+            line += " ";
+        line += GroundedAction(step.first,step.second).toString();
+    }
+    return line;
+}
+
+//=====================================================================================================================
+
+// Loads the macros of the domain of env. A line of the macro file is the support of a macro followed by its steps.
+vector<MacroSchema> load_macros(Env* env)
+{
+    vector<MacroSchema> macros;
+    ifstream macro_input(macro_file(env,".macros"));
+    string line;
+    while(getline(macro_input,line))
+    {
+        istringstream fields(line);
+        int support = 0;
+        string sequence;
+        fields>>support;
+        getline(fields,sequence);
+        vector<pair<string,list<string>>> steps;
+        if(!parse_action_sequence(sequence,steps))
+            continue;
+        string name = "Macro" + to_string(macros.size()+1);
+        for(const auto &step:steps)
+            name += "_" + step.first;
+        try
+        {
+            compile_macro(env,name,steps,support,macros);
+        }
+        catch(const runtime_error &)    //A schema of the macro is gone
+        {
+        }
+    }
+    return macros;
+}
+
+//=====================================================================================================================
+
+// Mines the plan corpus of the domain for frequent action subsequences of 2 to macro_max_length steps. Objects of a
+// subsequence become parameters in order of appearance and constants stay, so MoveToTable(A,B) Move(C,Table,A) and
+// MoveToTable(D,C) Move(B,Table,D) are both MoveToTable(?0,?1) Move(?2,Table,?0). Subsequences seen at least
+// macro_min_support times that compile are ranked by the steps they save, occurrences times length minus one, and the
+// best macro_limit of them are written to the macro file.
+void mine_macros(Env* env)
+{
+    const auto constants = schema_constants(env);
+    map<string,int> support;
+    ifstream corpus(macro_file(env,".plans"));
+    string line;
+    while(getline(corpus,line))
+    {
+        vector<pair<string,list<string>>> plan;
+        if(!parse_action_sequence(line,plan))
+            continue;
+        for(int length=2;length<=macro_max_length;length++)
+        {
+            for(int start=0;start+length<=(int)plan.size();start++)
+            {
+                unordered_map<string,string> parameters;
+                vector<pair<string,list<string>>> steps;
+                for(int i=start;i<start+length;i++)
+                {
+                    list<string> args;
+                    for(const auto &object:plan[i].second)
+                    {
+                        if(constants.count(object))
+                        {
+                            args.push_back(object);
+                            continue;
+                        }
+                        if(!parameters.count(object))
+                        {
+                            string parameter = "?" + to_string(parameters.size());
+                            parameters[object] = parameter;
+                        }
+                        args.push_back(parameters[object]);
+                    }
+                    steps.push_back({plan[i].first,args});
+                }
+                if((int)parameters.size()<=macro_max_parameters)
+                    support[action_sequence_string(steps)]++;
+            }
+        }
+    }
+
+    vector<tuple<int,int,string>> candidates;       //(-saved steps, -support, sequence)
+    for(const auto &entry:support)
+    {
+        vector<pair<string,list<string>>> steps;
+        vector<MacroSchema> compiled;
+        if(entry.second<macro_min_support || !parse_action_sequence(entry.first,steps))
+            continue;
+        try
+        {
+            if(!compile_macro(env,"Macro",steps,entry.second,compiled))
+                continue;
+        }
+        catch(const runtime_error &)
+        {
+            continue;
+        }
+        candidates.emplace_back(-entry.second*((int)steps.size()-1),-entry.second,entry.first);
+    }
+    sort(candidates.begin(),candidates.end());
+    if(candidates.size()>macro_limit)
+        candidates.resize(macro_limit);
+
+    string file_name = macro_file(env,".macros");
+    string temp_name = file_name + ".tmp";
+    {
+        ofstream macro_output(temp_name);
+        if(!macro_output.is_open())
+            return;
+        for(const auto &candidate:candidates)
+            macro_output<<-get<1>(candidate)<<" "<<get<2>(candidate)<<"\n";
+    }
+    rename(temp_name.c_str(),file_name.c_str());
+    if(log_enabled(LOG_INFO))
+        cout<<"Learned "<<candidates.size()<<" macros from the plan corpus"<<endl;
+}
+
+//=====================================================================================================================
+
+// Adds a solved plan, made of schema applications only, to the corpus of its domain and mines the corpus again
+void learn_macros(Env* env, const list<GroundedAction> &plan)
+{
+    mkdir(macro_dir.c_str(),0755);
+    {
+        ofstream corpus(macro_file(env,".plans"),ios::app);
+        if(!corpus.is_open())
+            return;
+        string line;
+        for(const auto &gaction:plan)
+            line += (line.empty() ? "" : " ") + gaction.toString();
+        corpus<<line<<"\n";
+    }
+    mine_macros(env);
+}
+
+//=====================================================================================================================
+
+// Backward relevance analysis. The goal atoms are relevant, an action is relevant when it adds a relevant atom, and the
+// preconditions of a relevant action are relevant. Dropping an irrelevant action from a plan cannot falsify a later
+// precondition or the goal, since all it changes are irrelevant atoms and deletions, so the irrelevant actions are
+// removed. Irrelevant atoms are removed from the initial state and from the effects of the remaining actions, which
+// makes them static; they keep their ids so that invariants and the h^2 table still line up.
+void prune_irrelevant(GroundedTask &task)
+{
+    const size_t n = task.atoms.size();
+    vector<vector<int>> achievers(n);
+    for(int a=0;a<(int)task.actions.size();a++)
+        for(int atom:task.add_effects[a])
+            achievers[atom].push_back(a);
+
+    vector<char> relevant_atom(n,0), relevant_action(task.actions.size(),0);
+    vector<int> worklist;
+    for(int atom:task.goal)
+    {
+        relevant_atom[atom] = 1;
+        worklist.push_back(atom);
+    }
+    while(!worklist.empty())
+    {
+        int atom = worklist.back();
+        worklist.pop_back();
+        for(int a:achievers[atom])
+        {
+            if(relevant_action[a])
+                continue;
+            relevant_action[a] = 1;
+            for(int precondition:task.preconditions[a])
+            {
+                if(!relevant_atom[precondition])
+                {
+                    relevant_atom[precondition] = 1;
+                    worklist.push_back(precondition);
+                }
+            }
+        }
+    }
+
+    auto relevant_only = [&](const vector<int> &atoms)
+    {
+        vector<int> kept;
+        for(int atom:atoms)
+            if(relevant_atom[atom])
+                kept.push_back(atom);
+        return kept;
+    };
+    GroundedTask pruned;
+    pruned.atoms = std::move(task.atoms);
+    pruned.atom_ids = std::move(task.atom_ids);
+    pruned.initial_state = relevant_only(task.initial_state);
+    pruned.goal = std::move(task.goal);
+    pruned.invariants = std::move(task.invariants);
+    pruned.h2_reachable = std::move(task.h2_reachable);
+    for(size_t a=0;a<task.actions.size();a++)
+    {
+        if(!relevant_action[a])
+            continue;
+        pruned.actions.push_back(std::move(task.actions[a]));
+        pruned.preconditions.push_back(std::move(task.preconditions[a]));
+        pruned.add_effects.push_back(relevant_only(task.add_effects[a]));
+        pruned.delete_effects.push_back(relevant_only(task.delete_effects[a]));
+    }
+    search_stats.relevance_pruned_actions += task.actions.size()-pruned.actions.size();
+    search_stats.relevance_pruned_atoms = count(relevant_atom.begin(),relevant_atom.end(),0);
+    task = std::move(pruned);
+    if(log_enabled(LOG_INFO))
+        cout<<"Relevance analysis: "<<search_stats.relevance_pruned_actions<<" actions and "
+            <<search_stats.relevance_pruned_atoms<<" of "<<n<<" atoms are irrelevant to the goal"<<endl;
+}
+
+//=====================================================================================================================
+
+// The h^2 pruning depends on the initial state, so tasks that outlive a change of it are grounded without it. Relevance
+// depends only on the goal and runs in both cases, again after h^2 when that removed actions.
+GroundedTask ground_task(Env* env, bool reachability_pruning = true)
+{
+    auto grounding_start = chrono::steady_clock::now();
+    GroundedTask task;
+    task.initial_state = task.intern_all(env->get_initial_conditions());
+    task.goal = task.intern_all(env->get_goal_conditions());
+    for(const auto &gaction:get_all_possible_actions(env->get_all_actions(),env->get_symbols()))
+        task.add_action(gaction);
+    if(!active_macros.empty())
+    {
+        auto macro_actions = ground_macros(env->get_symbols());
+        search_stats.macro_actions = macro_actions.size();
+        for(const auto &gaction:macro_actions)
+            task.add_action(gaction);
+    }
+    task.invariants = synthesize_invariants(env);
+    if(use_relevance_analysis)
+        prune_irrelevant(task);
+    if(use_h2_mutexes && reachability_pruning)
+    {
+        compute_h2_mutexes(task);
+        if(use_relevance_analysis && search_stats.h2_pruned_actions>0)
+            prune_irrelevant(task);
+    }
+    search_stats.grounding_seconds = seconds_since(grounding_start);
+    return task;
+}
+//=====================================================================================================================
+
+vector<bool> find_static_atoms(const GroundedTask &task);
+
+// Finite-domain (SAS+) view of a GroundedTask. The ground instances of the mutex invariants that hold initially are
+// turned into multi-valued variables, largest first, and every fluent atom left over becomes a binary variable. Value
+// i of a variable is its i-th atom; a variable that may have none of its atoms true gets one more value for that.
+// Static atoms are not stored at all. A state packs into packed_bytes() bytes of bit fields, so On(b,x) over n
+// objects costs one variable of about log2(n) bits per block instead of n atoms.
+class FiniteDomainTask
+{
+private:
+    struct Variable
+    {
+        vector<int> atoms;
+        bool has_none;
+        int bits;
+        int offset;
+    };
+
+    vector<Variable> variables;
+    vector<int> atom_variable;      //-1 for static atoms
+    vector<int> atom_value;
+    vector<int> static_true_atoms;
+    size_t total_bits = 0;
+
+    static void write_bits(unsigned char* out, int offset, int bits, int value)
+    {
+        for(int b=0;b<bits;b++)
+        {
+            unsigned char mask = (unsigned char)(1u << ((offset+b)%8));
+            if(value & (1 << b))
+                out[(offset+b)/8] |= mask;
+            else
+                out[(offset+b)/8] &= (unsigned char)~mask;
+        }
+    }
+
+    static int read_bits(const unsigned char* in, int offset, int bits)
+    {
+        int value = 0;
+        for(int b=0;b<bits;b++)
+            if(in[(offset+b)/8] & (1u << ((offset+b)%8)))
+                value |= 1 << b;
+        return value;
+    }
+
+public:
+    // Ground instances of the invariant as atom groups, or nothing when an instance has two atoms true initially
+    static vector<vector<int>> ground_invariant(const GroundedTask &task, const Invariant &invariant, const vector<bool> &is_static)
+    {
+        map<vector<string>,vector<int>> groups;
+        for(int atom=0;atom<(int)task.atoms.size();atom++)
+        {
+            const auto &condition = task.atoms[atom];
+            auto part = invariant.part_for(condition.get_predicate());
+            if(!part || !condition.get_truth() || is_static[atom])
+                continue;
+            auto args = condition.get_arg_values();
+            vector<string> arg_vector(args.begin(),args.end());
+            vector<string> parameters;
+            for(int position:part->fixed_positions)
+                if(position<(int)arg_vector.size())
+                    parameters.push_back(arg_vector[position]);
+            if(parameters.size()==part->fixed_positions.size())
+                groups[parameters].push_back(atom);
+        }
+
+        vector<vector<int>> grounded;
+        for(auto &group:groups)
+        {
+            int initially_true = 0;
+            for(int atom:group.second)
+                initially_true += binary_search(task.initial_state.begin(),task.initial_state.end(),atom);
+            if(initially_true>1)
+                return vector<vector<int>>();
+            grounded.push_back(std::move(group.second));
+        }
+        return grounded;
+    }
+
+    FiniteDomainTask(const GroundedTask &task)
+    {
+        const auto is_static = find_static_atoms(task);
+        vector<vector<int>> groups;
+        for(const auto &invariant:task.invariants)
+            for(auto &group:ground_invariant(task,invariant,is_static))
+                groups.push_back(std::move(group));
+        stable_sort(groups.begin(),groups.end(),[](const vector<int> &a, const vector<int> &b) { return a.size()>b.size(); });
+
+        this->atom_variable.assign(task.atoms.size(),-1);
+        this->atom_value.assign(task.atoms.size(),-1);
+        auto add_variable = [&](const vector<int> &atoms)
+        {
+            for(size_t value=0;value<atoms.size();value++)
+            {
+                this->atom_variable[atoms[value]] = this->variables.size();
+                this->atom_value[atoms[value]] = value;
+            }
+            this->variables.push_back(Variable{atoms,true,0,0});
+        };
+        for(const auto &group:groups)
+        {
+            vector<int> uncovered;
+            for(int atom:group)
+                if(this->atom_variable[atom]==-1)
+                    uncovered.push_back(atom);
+            if(uncovered.size()>=2)
+                add_variable(uncovered);
+        }
+        for(int atom=0;atom<(int)task.atoms.size();atom++)
+        {
+            if(is_static[atom])
+            {
+                if(binary_search(task.initial_state.begin(),task.initial_state.end(),atom))
+                    this->static_true_atoms.push_back(atom);
+            }
+            else if(this->atom_variable[atom]==-1)
+                add_variable({atom});
+        }
+
+        // A variable needs no "none" value when one of its atoms is true initially and every action that deletes one
+        // of them adds another
+        for(int v=0;v<(int)this->variables.size();v++)
+        {
+            auto &variable = this->variables[v];
+            bool always_one = false;
+            for(int atom:variable.atoms)
+                always_one = always_one || binary_search(task.initial_state.begin(),task.initial_state.end(),atom);
+            for(size_t a=0;a<task.actions.size() && always_one;a++)
+            {
+                bool deletes = false, adds = false;
+                for(int atom:task.delete_effects[a])
+                    deletes = deletes || this->atom_variable[atom]==v;
+                for(int atom:task.add_effects[a])
+                    adds = adds || this->atom_variable[atom]==v;
+                always_one = !deletes || adds;
+            }
+            variable.has_none = !always_one;
+            size_t values = variable.atoms.size() + variable.has_none;
+            while((size_t(1) << variable.bits)<values)
+                variable.bits++;
+            variable.offset = this->total_bits;
+            this->total_bits += variable.bits;
+        }
+    }
+
+    size_t variable_count() const
+    {
+        return this->variables.size();
+    }
+
+    size_t packed_bytes() const
+    {
+        return max<size_t>((this->total_bits+7)/8,1);
+    }
+
+    void pack(const vector<int> &state, unsigned char* out) const
+    {
+        memset(out,0,this->packed_bytes());
+        for(const auto &variable:this->variables)
+            if(variable.has_none)
+                write_bits(out,variable.offset,variable.bits,variable.atoms.size());
+        for(int atom:state)
+        {
+            int v = this->atom_variable[atom];
+            if(v!=-1)
+                write_bits(out,this->variables[v].offset,this->variables[v].bits,this->atom_value[atom]);
+        }
+    }
+
+    string pack(const vector<int> &state) const
+    {
+        string packed(this->packed_bytes(),'\0');
+        this->pack(state,(unsigned char*)&packed[0]);
+        return packed;
+    }
+
+    vector<int> unpack(const unsigned char* in) const
+    {
+        vector<int> state = this->static_true_atoms;
+        for(const auto &variable:this->variables)
+        {
+            int value = read_bits(in,variable.offset,variable.bits);
+            if(value<(int)variable.atoms.size())
+                state.push_back(variable.atoms[value]);
+        }
+        sort(state.begin(),state.end());
+        return state;
+    }
+};
+
+//=====================================================================================================================
+
+// Struct-of-arrays copy of the grounded actions for a brute-force applicability scan, which does not chase the
+// per-action hash sets of GroundedAction. A state is a bit set over atom ids. Actions are laid out in tiles of four
+// lanes, and entry e of a tile holds, for each lane, the index of one state word and the mask of that lane's
+// preconditions within the word. Lanes with fewer precondition words are padded with empty masks. Testing a tile
+// costs one gather, and-not and or per entry, so the SSE2 and AVX2 kernels test two and four actions per
+// instruction. The scalar kernel is the portable fallback. Add and delete effects are stored as flat index arrays
+// with per-action offsets, next to the action costs.
+class ActionTable
+{
+private:
+    static const int lanes = 4;
+    int action_count;
+    int word_count;
+    vector<uint32_t> tile_offsets;          //First entry of every tile, plus one past the last
+    vector<int32_t> precondition_words;     //entries * lanes, lane index varies fastest
+    vector<uint64_t> precondition_masks;
+    vector<uint32_t> add_offsets;
+    vector<int> add_atoms;
+    vector<uint32_t> delete_offsets;
+    vector<int> delete_atoms;
+    vector<double> costs;                   //Every action costs 1 in this planner
+
+    void emit_tile(unsigned applicable, int tile, vector<int> &actions) const
+    {
+        for(;applicable;applicable&=applicable-1)
+        {
+            int action = tile*lanes + __builtin_ctz(applicable);
+            if(action<this->action_count)   //Padding lanes of the last tile have no preconditions
+                actions.push_back(action);
+        }
+    }
+
+    void scan_scalar(const uint64_t* state, vector<int> &actions) const
+    {
+        for(int tile=0;tile+1<(int)this->tile_offsets.size();tile++)
+        {
+            unsigned applicable = 0;
+            for(int lane=0;lane<lanes;lane++)
+            {
+                uint64_t missing = 0;
+                for(uint32_t e=this->tile_offsets[tile];e<this->tile_offsets[tile+1];e++)
+                    missing |= this->precondition_masks[e*lanes+lane] & ~state[this->precondition_words[e*lanes+lane]];
+                applicable |= (unsigned)(missing==0) << lane;
+            }
+            this->emit_tile(applicable,tile,actions);
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    void scan_sse2(const uint64_t* state, vector<int> &actions) const
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for(int tile=0;tile+1<(int)this->tile_offsets.size();tile++)
+        {
+            __m128i missing_low = zero, missing_high = zero;
+            for(uint32_t e=this->tile_offsets[tile];e<this->tile_offsets[tile+1];e++)
+            {
+                const int32_t* words = &this->precondition_words[e*lanes];
+                const __m128i* masks = (const __m128i*)&this->precondition_masks[e*lanes];
+                __m128i low = _mm_set_epi64x(state[words[1]],state[words[0]]);
+                __m128i high = _mm_set_epi64x(state[words[3]],state[words[2]]);
+                missing_low = _mm_or_si128(missing_low,_mm_andnot_si128(low,_mm_loadu_si128(masks)));
+                missing_high = _mm_or_si128(missing_high,_mm_andnot_si128(high,_mm_loadu_si128(masks+1)));
+            }
+            // SSE2 has no 64 bit compare, a lane is clear when both of its 32 bit halves are
+            unsigned halves = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(missing_low,zero)))
+                              | _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(missing_high,zero))) << 4;
+            unsigned applicable = 0;
+            for(int lane=0;lane<lanes;lane++)
+                applicable |= (unsigned)(((halves>>(2*lane))&3)==3) << lane;
+            this->emit_tile(applicable,tile,actions);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void scan_avx2(const uint64_t* state, vector<int> &actions) const
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        for(int tile=0;tile+1<(int)this->tile_offsets.size();tile++)
+        {
+            __m256i missing = zero;
+            for(uint32_t e=this->tile_offsets[tile];e<this->tile_offsets[tile+1];e++)
+            {
+                __m128i words = _mm_loadu_si128((const __m128i*)&this->precondition_words[e*lanes]);
+                __m256i state_words = _mm256_i32gather_epi64((const long long*)state,words,8);
+                __m256i masks = _mm256_loadu_si256((const __m256i*)&this->precondition_masks[e*lanes]);
+                missing = _mm256_or_si256(missing,_mm256_andnot_si256(state_words,masks));
+            }
+            unsigned applicable = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(missing,zero)));
+            this->emit_tile(applicable,tile,actions);
+        }
+    }
+#endif
+
+public:
+    struct AtomRange
+    {
+        const int* first;
+        const int* last;
+        const int* begin() const { return this->first; }
+        const int* end() const { return this->last; }
+    };
+
+    explicit ActionTable(const GroundedTask &task):
+            action_count(task.actions.size()),word_count((task.atoms.size()+63)/64)
+    {
+        this->tile_offsets.push_back(0);
+        for(int first=0;first<this->action_count;first+=lanes)
+        {
+            // Merge the preconditions of every lane into (word, mask) entries
+            vector<vector<pair<int32_t,uint64_t>>> lane_entries(lanes);
+            for(int lane=0;lane<lanes && first+lane<this->action_count;lane++)
+            {
+                for(int atom:task.preconditions[first+lane])
+                {
+                    auto &entries = lane_entries[lane];
+                    if(entries.empty() || entries.back().first!=atom/64)
+                        entries.push_back({atom/64,0});
+                    entries.back().second |= (uint64_t)1 << (atom%64);
+                }
+            }
+            size_t entry_count = 0;
+            for(const auto &entries:lane_entries)
+                entry_count = max(entry_count,entries.size());
+            for(size_t e=0;e<entry_count;e++)
+            {
+                for(int lane=0;lane<lanes;lane++)
+                {
+                    bool used = e<lane_entries[lane].size();
+                    this->precondition_words.push_back(used ? lane_entries[lane][e].first : 0);
+                    this->precondition_masks.push_back(used ? lane_entries[lane][e].second : 0);
+                }
+            }
+            this->tile_offsets.push_back(this->tile_offsets.back()+entry_count);
+        }
+
+        this->add_offsets.push_back(0);
+        this->delete_offsets.push_back(0);
+        for(int a=0;a<this->action_count;a++)
+        {
+            this->add_atoms.insert(this->add_atoms.end(),task.add_effects[a].begin(),task.add_effects[a].end());
+            this->add_offsets.push_back(this->add_atoms.size());
+            this->delete_atoms.insert(this->delete_atoms.end(),task.delete_effects[a].begin(),task.delete_effects[a].end());
+            this->delete_offsets.push_back(this->delete_atoms.size());
+            this->costs.push_back(1);
+        }
+    }
+
+    static int best_kernel()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if(__builtin_cpu_supports("avx2"))
+            return SCAN_AVX2;
+        return SCAN_SSE2;
+#else
+        return SCAN_SCALAR;
+#endif
+    }
+
+    int words() const
+    {
+        return this->word_count;
+    }
+
+    // Writes the bit set of a sorted atom id state into bits, which must hold words() entries
+    void state_bits(const vector<int> &state, uint64_t* bits) const
+    {
+        fill(bits,bits+this->word_count,0);
+        for(int atom:state)
+            bits[atom/64] |= (uint64_t)1 << (atom%64);
+    }
+
+    // Fills actions with the ids of the actions applicable in the state, in increasing order
+    void applicable_actions(const uint64_t* state, vector<int> &actions, int kernel = applicability_kernel) const
+    {
+        actions.clear();
+        if(kernel==SCAN_AUTO)
+            kernel = best_kernel();
+#if defined(__x86_64__) || defined(__i386__)
+        if(kernel==SCAN_AVX2 && __builtin_cpu_supports("avx2"))
+            return this->scan_avx2(state,actions);
+        if(kernel!=SCAN_SCALAR)
+            return this->scan_sse2(state,actions);
+#endif
+        this->scan_scalar(state,actions);
+    }
+
+    AtomRange add_effects(int action) const
+    {
+        return AtomRange{this->add_atoms.data()+this->add_offsets[action],this->add_atoms.data()+this->add_offsets[action+1]};
+    }
+
+    AtomRange delete_effects(int action) const
+    {
+        return AtomRange{this->delete_atoms.data()+this->delete_offsets[action],
+                         this->delete_atoms.data()+this->delete_offsets[action+1]};
+    }
+
+    double cost(int action) const
+    {
+        return this->costs[action];
+    }
+};
+
+//=====================================================================================================================
+
+// Strong stubborn sets (partial order reduction). For a state that is not a goal the stubborn set starts from the
+// achievers of one unsatisfied goal atom and is closed under two rules: an applicable action pulls in every action it
+// interferes with, an inapplicable one pulls in the achievers of one of its unsatisfied preconditions. Expanding only
+// the applicable actions in the set preserves optimal solutions under A*.
+//
+// Two actions interfere when one deletes a precondition of the other or one deletes what the other adds. The
+// atom -> action tables are built at grounding time; the per-action interference lists are precomputed too unless
+// they would exceed stubborn_interference_budget entries, in which case they are derived from the tables on demand.
+class StrongStubbornSets
+{
+private:
+    const GroundedTask &task;
+    vector<vector<int>> achievers;          //atom -> actions that add it
+    vector<vector<int>> precondition_of;    //atom -> actions that require it
+    vector<vector<int>> deleters;           //atom -> actions that delete it
+    vector<vector<int>> interference;       //action -> interfering actions, empty when not precomputed
+    bool interference_precomputed = false;
+    vector<unsigned> action_stamp;
+    unsigned stamp = 0;
+    vector<int> scratch;
+
+    void collect_interfering(int action, vector<int> &result)
+    {
+        result.clear();
+        ++this->stamp;
+        this->action_stamp[action] = this->stamp;
+        auto add_all = [&](const vector<int> &actions)
+        {
+            for(int other:actions)
+            {
+                if(this->action_stamp[other]!=this->stamp)
+                {
+                    this->action_stamp[other] = this->stamp;
+                    result.push_back(other);
+                }
+            }
+        };
+        for(int atom:this->task.delete_effects[action])
+        {
+            add_all(this->precondition_of[atom]);
+            add_all(this->achievers[atom]);
+        }
+        for(int atom:this->task.preconditions[action])
+            add_all(this->deleters[atom]);
+        for(int atom:this->task.add_effects[action])
+            add_all(this->deleters[atom]);
+    }
+
+    int cheapest_unsatisfied(const vector<int> &atoms, const vector<int> &state) const
+    {
+        int best = -1;
+        for(int atom:atoms)
+        {
+            if(binary_search(state.begin(),state.end(),atom))
+                continue;
+            if(best==-1 || this->achievers[atom].size()<this->achievers[best].size())
+                best = atom;
+        }
+        return best;
+    }
+
+public:
+    StrongStubbornSets(const GroundedTask &task, size_t interference_budget): task(task)
+    {
+        size_t n_atoms = task.atoms.size();
+        this->achievers.resize(n_atoms);
+        this->precondition_of.resize(n_atoms);
+        this->deleters.resize(n_atoms);
+        for(int a=0;a<(int)task.actions.size();a++)
+        {
+            for(int atom:task.add_effects[a])
+                this->achievers[atom].push_back(a);
+            for(int atom:task.preconditions[a])
+                this->precondition_of[atom].push_back(a);
+            for(int atom:task.delete_effects[a])
+                this->deleters[atom].push_back(a);
+        }
+        this->action_stamp.assign(task.actions.size(),0);
+
+        size_t estimated_size = 0;
+        for(int a=0;a<(int)task.actions.size();a++)
+        {
+            for(int atom:task.delete_effects[a])
+                estimated_size += this->precondition_of[atom].size() + this->achievers[atom].size();
+            for(int atom:task.preconditions[a])
+                estimated_size += this->deleters[atom].size();
+            for(int atom:task.add_effects[a])
+                estimated_size += this->deleters[atom].size();
+        }
+        if(estimated_size<=interference_budget)
+        {
+            this->interference.resize(task.actions.size());
+            for(int a=0;a<(int)task.actions.size();a++)
+                this->collect_interfering(a,this->interference[a]);
+            this->interference_precomputed = true;
+        }
+    }
+
+    // Fills applicable_actions with the applicable actions of the stubborn set of state, in increasing id order.
+    void compute(const vector<int> &state, vector<int> &applicable_actions)
+    {
+        applicable_actions.clear();
+        int goal_atom = this->cheapest_unsatisfied(this->task.goal,state);
+        if(goal_atom==-1)
+        {
+            for(int a=0;a<(int)this->task.actions.size();a++)
+                if(this->task.is_applicable(state,a))
+                    applicable_actions.push_back(a);
+            return;
+        }
+
+        vector<bool> in_set(this->task.actions.size(),false);
+        vector<int> worklist;
+        auto add_all = [&](const vector<int> &actions)
+        {
+            for(int a:actions)
+            {
+                if(!in_set[a])
+                {
+                    in_set[a] = true;
+                    worklist.push_back(a);
+                }
+            }
+        };
+
+        add_all(this->achievers[goal_atom]);
+        while(!worklist.empty())
+        {
+            int action = worklist.back();
+            worklist.pop_back();
+            int missing = this->cheapest_unsatisfied(this->task.preconditions[action],state);
+            if(missing==-1)
+            {
+                applicable_actions.push_back(action);
+                if(this->interference_precomputed)
+                    add_all(this->interference[action]);
+                else
+                {
+                    this->collect_interfering(action,this->scratch);
+                    add_all(this->scratch);
+                }
+            }
+            else
+                add_all(this->achievers[missing]);
+        }
+        sort(applicable_actions.begin(),applicable_actions.end());
+    }
+};
+
+//=====================================================================================================================
+
+// Object symmetries. A permutation of the objects that fixes the constants used in the action schemas maps grounded
+// actions onto grounded actions, so when it also maps the goal (and the static facts) onto itself, two states related
+// by it have the same goal distance. The permutations are found as automorphisms of a problem description graph: one
+// vertex per object, one per goal or static atom coloured by its predicate, and one per argument position linking
+// the atom to its object. Generators are searched with colour refinement and individualisation on two copies of the
+// graph, and every candidate is verified on the atom sets before it is kept.
+//
+// A* then keys its duplicate detection on a canonical representative of each state: the lexicographically smallest
+// state reachable by greedily applying generators. Nodes keep their real states, so back_track is unaffected.
+class ObjectSymmetries
+{
+private:
+    const GroundedTask &task;
+    vector<vector<int>> atom_permutations;      //One per generator: atom id -> atom id
+
+    // Problem description graph
+    int n_objects = 0;
+    vector<int> initial_colors;
+    vector<vector<int>> adjacency;
+
+    static void refine(const vector<vector<int>> &adjacency, vector<int> &colors)
+    {
+        size_t n_classes = set<int>(colors.begin(),colors.end()).size();
+        while(true)
+        {
+            vector<vector<int>> signatures(colors.size());
+            for(size_t v=0;v<colors.size();v++)
+            {
+                signatures[v].push_back(colors[v]);
+                vector<int> neighbor_colors;
+                for(int u:adjacency[v])
+                    neighbor_colors.push_back(colors[u]);
+                sort(neighbor_colors.begin(),neighbor_colors.end());
+                signatures[v].insert(signatures[v].end(),neighbor_colors.begin(),neighbor_colors.end());
+            }
+            vector<vector<int>> distinct = signatures;
+            sort(distinct.begin(),distinct.end());
+            distinct.erase(unique(distinct.begin(),distinct.end()),distinct.end());
+            for(size_t v=0;v<colors.size();v++)
+                colors[v] = lower_bound(distinct.begin(),distinct.end(),signatures[v])-distinct.begin();
+            if(distinct.size()==n_classes)
+                return;
+            n_classes = distinct.size();
+        }
+    }
+
+    // Looks for a graph automorphism that maps object from onto object to, returned as an object permutation.
+    vector<int> find_automorphism(int from, int to) const
+    {
+        const int n = this->adjacency.size();
+        vector<vector<int>> twin_adjacency(2*n);
+        vector<int> colors(2*n);
+        for(int v=0;v<n;v++)
+        {
+            for(int u:this->adjacency[v])
+            {
+                twin_adjacency[v].push_back(u);
+                twin_adjacency[v+n].push_back(u+n);
+            }
+            colors[v] = colors[v+n] = this->initial_colors[v];
+        }
+
+        int first = from, second = to+n;
+        while(true)
+        {
+            int fresh = *max_element(colors.begin(),colors.end())+1;
+            colors[first] = colors[second] = fresh;
+            refine(twin_adjacency,colors);
+
+            unordered_map<int,pair<int,int>> class_sizes;
+            for(int v=0;v<2*n;v++)
+            {
+                if(v<n)
+                    class_sizes[colors[v]].first++;
+                else
+                    class_sizes[colors[v]].second++;
+            }
+            first = -1;
+            for(const auto &class_size:class_sizes)
+                if(class_size.second.first!=class_size.second.second)
+                    return vector<int>();
+            for(int v=0;v<n && first==-1;v++)
+                if(class_sizes[colors[v]].first>1)
+                    first = v;
+            if(first==-1)
+                break;
+            for(int v=n;v<2*n;v++)
+            {
+                if(colors[v]==colors[first])
+                {
+                    second = v;
+                    break;
+                }
+            }
+        }
+
+        unordered_map<int,int> vertex_of_color;
+        for(int v=n;v<2*n;v++)
+            vertex_of_color[colors[v]] = v-n;
+        vector<int> object_permutation(this->n_objects);
+        for(int o=0;o<this->n_objects;o++)
+        {
+            object_permutation[o] = vertex_of_color[colors[o]];
+            if(object_permutation[o]>=this->n_objects)
+                return vector<int>();
+        }
+        return object_permutation;
+    }
+
+    static GroundedCondition permute_atom(const GroundedCondition &atom, const unordered_map<string,string> &renaming)
+    {
+        list<string> args;
+        for(const auto &arg:atom.get_arg_values())
+        {
+            auto found = renaming.find(arg);
+            args.push_back(found==renaming.end() ? arg : found->second);
+        }
+        return GroundedCondition(atom.get_predicate(),args,atom.get_truth());
+    }
+
+public:
+    ObjectSymmetries(Env* env, const GroundedTask &task): task(task)
+    {
+        // Constants of the schemas (e.g. Table in MoveToTable) and predicates that actions change
+        unordered_set<string> constants;
+        unordered_set<string> dynamic_predicates;
+        for(const auto &action:env->get_all_actions())
+        {
+            auto params = action.get_args();
+            unordered_set<string> parameters(params.begin(),params.end());
+            for(const auto &conditions:{action.get_preconditions(),action.get_effects()})
+                for(const auto &condition:conditions)
+                    for(const auto &arg:condition.get_args())
+                        if(!parameters.count(arg))
+                            constants.insert(arg);
+            for(const auto &effect:action.get_effects())
+                dynamic_predicates.insert(effect.get_predicate());
+        }
+
+        auto symbol_set = env->get_symbols();
+        vector<string> objects(symbol_set.begin(),symbol_set.end());
+        sort(objects.begin(),objects.end());
+        this->n_objects = objects.size();
+        unordered_map<string,int> object_index;
+        for(int o=0;o<this->n_objects;o++)
+            object_index[objects[o]] = o;
+
+        vector<string> vertex_labels;
+        for(const auto &object:objects)
+            vertex_labels.push_back(constants.count(object) ? "constant:" + object : "object");
+        this->adjacency.resize(this->n_objects);
+        auto add_vertex = [&](const string &label)
+        {
+            vertex_labels.push_back(label);
+            this->adjacency.emplace_back();
+            return (int)vertex_labels.size()-1;
+        };
+        auto add_edge = [&](int u, int v)
+        {
+            this->adjacency[u].push_back(v);
+            this->adjacency[v].push_back(u);
+        };
+
+        vector<pair<string,GroundedCondition>> graph_atoms;
+        for(const auto &goal:env->get_goal_conditions())
+            graph_atoms.emplace_back("goal",goal);
+        for(const auto &initial:env->get_initial_conditions())
+            if(!dynamic_predicates.count(initial.get_predicate()))
+                graph_atoms.emplace_back("static",initial);
+        for(const auto &graph_atom:graph_atoms)
+        {
+            const auto &atom = graph_atom.second;
+            int atom_vertex = add_vertex(graph_atom.first + ":" + atom.toString().substr(0,atom.toString().find('(')));
+            int position = 0;
+            for(const auto &arg:atom.get_arg_values())
+            {
+                int position_vertex = add_vertex("position:" + to_string(position++));
+                add_edge(atom_vertex,position_vertex);
+                auto found = object_index.find(arg);
+                if(found==object_index.end())
+                    found = object_index.insert({arg,add_vertex("constant:" + arg)}).first;
+                add_edge(position_vertex,found->second);
+            }
+        }
+
+        vector<string> distinct_labels = vertex_labels;
+        sort(distinct_labels.begin(),distinct_labels.end());
+        distinct_labels.erase(unique(distinct_labels.begin(),distinct_labels.end()),distinct_labels.end());
+        for(const auto &label:vertex_labels)
+            this->initial_colors.push_back(lower_bound(distinct_labels.begin(),distinct_labels.end(),label)-distinct_labels.begin());
+
+        vector<int> colors = this->initial_colors;
+        refine(this->adjacency,colors);
+
+        // For every class of equally coloured objects, map its first object onto each member not yet in its orbit
+        vector<int> orbit_of(this->n_objects,-1);
+        vector<vector<int>> object_generators;
+        for(int o=0;o<this->n_objects;o++)
+        {
+            if(orbit_of[o]!=-1)
+                continue;
+            orbit_of[o] = o;
+            for(int other=o+1;other<this->n_objects;other++)
+            {
+                if(colors[other]!=colors[o] || orbit_of[other]!=-1)
+                    continue;
+                auto permutation = this->find_automorphism(o,other);
+                if(permutation.empty())
+                    continue;
+                object_generators.push_back(permutation);
+                // Grow the orbit of o under the generators found so far
+                vector<int> frontier{o};
+                while(!frontier.empty())
+                {
+                    int x = frontier.back();
+                    frontier.pop_back();
+                    for(const auto &generator:object_generators)
+                    {
+                        if(orbit_of[generator[x]]==-1)
+                        {
+                            orbit_of[generator[x]] = o;
+                            frontier.push_back(generator[x]);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Verify each generator on the goal and static atoms and turn it into a permutation of the task's atoms
+        unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> described_atoms;
+        for(const auto &graph_atom:graph_atoms)
+            described_atoms.insert(graph_atom.second);
+        for(const auto &generator:object_generators)
+        {
+            unordered_map<string,string> renaming;
+            for(int o=0;o<this->n_objects;o++)
+                if(generator[o]!=o)
+                    renaming[objects[o]] = objects[generator[o]];
+
+            bool valid = true;
+            for(const auto &atom:described_atoms)
+                valid = valid && described_atoms.count(permute_atom(atom,renaming));
+            vector<int> atom_permutation(task.atoms.size());
+            for(size_t a=0;a<task.atoms.size() && valid;a++)
+            {
+                auto image = task.atom_ids.find(permute_atom(task.atoms[a],renaming));
+                valid = image!=task.atom_ids.end();
+                if(valid)
+                    atom_permutation[a] = image->second;
+            }
+            if(valid)
+                this->atom_permutations.push_back(atom_permutation);
+        }
+    }
+
+    size_t generator_count() const
+    {
+        return this->atom_permutations.size();
+    }
+
+    vector<int> canonical(vector<int> state) const
+    {
+        vector<int> image;
+        bool changed = true;
+        while(changed)
+        {
+            changed = false;
+            for(const auto &permutation:this->atom_permutations)
+            {
+                image.clear();
+                for(int atom:state)
+                    image.push_back(permutation[atom]);
+                sort(image.begin(),image.end());
+                if(image<state)
+                {
+                    state.swap(image);
+                    changed = true;
+                }
+            }
+        }
+        return state;
+    }
+};
+
+//=====================================================================================================================
+
+// Duplicate detection in A* keys a state by its finite-domain packing, taken after mapping the state to its canonical
+// representative when symmetry pruning is on. Lifted search has no grounded task and keys a state by its conditions.
+string StateKeys::key(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &state) const
+{
+    if(!this->task)
+        return canonical_conditions_string(state);
+    return this->key(this->task->state_ids(state));
+}
+
+string StateKeys::key(vector<int> atoms) const
+{
+    if(this->symmetries)
+        atoms = this->symmetries->canonical(std::move(atoms));
+    return this->fdr->pack(atoms);
+}
+
+string StateKeys::key(const Node &node) const
+{
+    if(node.packed.empty())
+        return this->key(node.gc);
+    if(!this->symmetries)
+        return node.packed;
+    return this->key(this->unpack(node));
+}
+
+string StateKeys::pack(const vector<int> &atoms) const
+{
+    return this->fdr->pack(atoms);
+}
+
+vector<int> StateKeys::unpack(const Node &node) const
+{
+    return this->fdr->unpack((const unsigned char*)node.packed.data());
+}
+
+vector<int> StateKeys::apply(const vector<int> &atoms, int action) const
+{
+    return this->task->apply(atoms,action);
+}
+
+string search_state_key(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &state,
+                        const StateKeys &state_keys)
+{
+    return state_keys.key(state);
+}
+
+//=====================================================================================================================
+
+// Gives back the estimated heap memory charged for everything the A* containers hold. The container slots themselves
+// are returned by PoolAllocator when the containers are destroyed.
+void release_search_memory(const NodeMap &node_map,
+                           const OpenList &open,
+                           const StateGcostMap &best_gcost,
+                           const StateKeySet &closed)
+{
+    size_t bytes = 0;
+    for(const auto &entry:node_map)
+        bytes += approximate_node_bytes(entry.second);
+    for(const auto &node:open.nodes())
+        bytes += approximate_node_bytes(node);
+    for(const auto &entry:best_gcost)
+        bytes += string_heap_bytes(entry.first);
+    for(const auto &key:closed)
+        bytes += string_heap_bytes(key);
+    memory_accountant.release(bytes);
+}
+
+//=====================================================================================================================
+
+// Drops the closed list, the gcosts of states that are no longer on open and every node that is not an ancestor of an
+// open node. The search stays able to backtrack from any node on open but may expand evicted states again.
+void evict_search_memory(NodeMap &node_map,
+                         OpenList &open,
+                         StateGcostMap &best_gcost,
+                         StateKeySet &closed,
+                         const StateKeys &state_keys)
+{
+    size_t released = 0;
+    for(const auto &key:closed)
+        released += string_heap_bytes(key);
+    for(const auto &entry:best_gcost)
+        released += string_heap_bytes(entry.first);
+    StateKeySet().swap(closed);
+    StateGcostMap().swap(best_gcost);
+
+    unordered_set<int> keep;
+    for(const auto &node:open.nodes())
+    {
+        auto key = state_keys.key(node);
+        auto best = best_gcost.find(key);
+        if(best==best_gcost.end())
+        {
+            memory_accountant.charge(string_heap_bytes(key));
+            best_gcost.insert({key,node.gcost});
+        }
+        else
+            best->second = min(best->second,node.gcost);
+        for(int index=node.neighbors.empty() ? -1 : node.neighbors[0]; index!=-1 && keep.insert(index).second;)
+        {
+            const auto &ancestor = node_map.at(index);
+            index = ancestor.neighbors.empty() ? -1 : ancestor.neighbors[0];
+        }
+    }
+    for(auto it=node_map.begin();it!=node_map.end();)
+    {
+        if(keep.count(it->first))
+            ++it;
+        else
+        {
+            released += approximate_node_bytes(it->second);
+            it = node_map.erase(it);
+        }
+    }
+    memory_accountant.release(released);
+}
+
+//=====================================================================================================================
+
+// Successor generation from the lifted schemas, for tasks too large to ground. The positive preconditions of a schema
+// are joined over the facts of the state like a database query: they are matched one at a time, the one with the most
+// bound arguments first, and every match extends the parameter binding. As in get_all_possible_permutations the
+// parameters take distinct objects, and parameters that no precondition mentions range over the unused symbols. A
+// schema with a negative precondition is never applicable, matching the grounded semantics.
+class LiftedSuccessorGenerator
+{
+private:
+    struct LiftedAtom
+    {
+        string predicate;
+        vector<int> parameters;         //Parameter index for each argument, -1 for a constant
+        vector<string> constants;
+    };
+
+    struct Schema
+    {
+        Action action;
+        size_t parameter_count;
+        vector<LiftedAtom> preconditions;   //In join order
+        bool never_applicable;
+    };
+
+    typedef unordered_map<string,vector<vector<string>>> FactIndex;
+
+    vector<Schema> schemas;
+    vector<string> symbols;
+
+    static bool is_bound(const vector<string> &binding, int parameter)
+    {
+        return !binding[parameter].empty();
+    }
+
+    static bool is_used(const vector<string> &binding, const string &symbol)
+    {
+        return find(binding.begin(),binding.end(),symbol)!=binding.end();
+    }
+
+    void bind_free_parameters(const Schema &schema, size_t parameter, vector<string> &binding,
+                              vector<GroundedAction> &applicable) const
+    {
+        if(parameter==schema.parameter_count)
+        {
+            GroundedAction gaction{schema.action.get_name(),list<string>()};
+            ground_action_from_schema(schema.action,list<string>(binding.begin(),binding.end()),gaction);
+            applicable.push_back(std::move(gaction));
+            return;
+        }
+        if(is_bound(binding,parameter))
+        {
+            this->bind_free_parameters(schema,parameter+1,binding,applicable);
+            return;
+        }
+        for(const auto &symbol:this->symbols)
+        {
+            if(is_used(binding,symbol))
+                continue;
+            binding[parameter] = symbol;
+            this->bind_free_parameters(schema,parameter+1,binding,applicable);
+        }
+        binding[parameter].clear();
+    }
+
+    void join(const Schema &schema, size_t depth, vector<string> &binding, const FactIndex &facts,
+              vector<GroundedAction> &applicable) const
+    {
+        if(depth==schema.preconditions.size())
+        {
+            this->bind_free_parameters(schema,0,binding,applicable);
+            return;
+        }
+        const auto &atom = schema.preconditions[depth];
+        auto relation = facts.find(atom.predicate);
+        if(relation==facts.end())
+            return;
+
+        vector<int> newly_bound;
+        for(const auto &fact:relation->second)
+        {
+            if(fact.size()!=atom.parameters.size())
+                continue;
+            bool matches = true;
+            for(size_t i=0;i<fact.size() && matches;i++)
+            {
+                int parameter = atom.parameters[i];
+                if(parameter==-1)
+                    matches = fact[i]==atom.constants[i];
+                else if(is_bound(binding,parameter))
+                    matches = binding[parameter]==fact[i];
+                else if(is_used(binding,fact[i]))
+                    matches = false;
+                else
+                {
+                    binding[parameter] = fact[i];
+                    newly_bound.push_back(parameter);
+                }
+            }
+            if(matches)
+                this->join(schema,depth+1,binding,facts,applicable);
+            for(int parameter:newly_bound)
+                binding[parameter].clear();
+            newly_bound.clear();
+        }
+    }
+
+public:
+    LiftedSuccessorGenerator(Env* env)
+    {
+        auto symbol_set = env->get_symbols();
+        this->symbols.assign(symbol_set.begin(),symbol_set.end());
+        sort(this->symbols.begin(),this->symbols.end());
+
+        for(const auto &action:env->get_all_actions())
+        {
+            auto args = action.get_args();
+            vector<string> parameters(args.begin(),args.end());
+            Schema schema{action,parameters.size(),{},false};
+            vector<LiftedAtom> remaining;
+            for(const auto &precondition:action.get_preconditions())
+            {
+                if(!precondition.get_truth())
+                {
+                    schema.never_applicable = true;
+                    continue;
+                }
+                LiftedAtom atom{precondition.get_predicate(),{},{}};
+                for(const auto &arg:precondition.get_args())
+                {
+                    auto found = find(parameters.begin(),parameters.end(),arg);
+                    atom.parameters.push_back(found==parameters.end() ? -1 : found-parameters.begin());
+                    atom.constants.push_back(found==parameters.end() ? arg : "");
+                }
+                remaining.push_back(atom);
+            }
+
+            // Greedy join order: next the atom with the most arguments already fixed by constants or earlier atoms
+            vector<char> bound(parameters.size(),0);
+            while(!remaining.empty())
+            {
+                auto fixed_arguments = [&](const LiftedAtom &atom)
+                {
+                    int fixed = 0;
+                    for(int parameter:atom.parameters)
+                        fixed += parameter==-1 || bound[parameter];
+                    return fixed;
+                };
+                auto best = max_element(remaining.begin(),remaining.end(),[&](const LiftedAtom &a, const LiftedAtom &b)
+                {
+                    return fixed_arguments(a)<fixed_arguments(b);
+                });
+                for(int parameter:best->parameters)
+                    if(parameter!=-1)
+                        bound[parameter] = 1;
+                schema.preconditions.push_back(*best);
+                remaining.erase(best);
+            }
+            this->schemas.push_back(schema);
+        }
+    }
+
+    vector<GroundedAction> applicable_actions(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &state) const
+    {
+        FactIndex facts;
+        for(const auto &fact:state)
+        {
+            auto args = fact.get_arg_values();
+            facts[fact.get_predicate()].emplace_back(args.begin(),args.end());
+        }
+
+        vector<GroundedAction> applicable;
+        for(const auto &schema:this->schemas)
+        {
+            if(schema.never_applicable)
+                continue;
+            vector<string> binding(schema.parameter_count);
+            this->join(schema,0,binding,facts,applicable);
+        }
+        return applicable;
+    }
+};
+
+//=====================================================================================================================
+
+// Without a grounded task (lifted search) the applicable actions of every expanded state come from a
+// LiftedSuccessorGenerator, and the pruning techniques that need the grounded task are off.
+list<GroundedAction> astar_planner(Env* env, const GroundedTask* task)
+{
+
+    list<GroundedAction> actions;
+    OpenList open;
+    NodeMap node_map;   //This serves as my map since it's an implicit directed graph. Holds the expanded nodes, the
+                        //generated ones are only on open
+    unique_ptr<LiftedSuccessorGenerator> lifted;
+    vector<GroundedAction> lifted_actions;      //Applicable actions of the state being expanded in lifted search
+    if(!task)
+        lifted.reset(new LiftedSuccessorGenerator(env));
+    const auto &action_list = task ? task->actions : lifted_actions;
+    unique_ptr<StrongStubbornSets> stubborn_sets;
+    if(use_stubborn_sets && task)
+        stubborn_sets.reset(new StrongStubbornSets(*task,stubborn_interference_budget));
+    unique_ptr<ObjectSymmetries> symmetries;
+    if(use_symmetry_pruning && task)
+    {
+        symmetries.reset(new ObjectSymmetries(env,*task));
+        search_stats.symmetry_generators = symmetries->generator_count();
+        if(log_enabled(LOG_INFO))
+            cout<<"Found "<<symmetries->generator_count()<<" object symmetry generators"<<endl;
+    }
+    unique_ptr<FiniteDomainTask> fdr;
+    if(task)
+    {
+        fdr.reset(new FiniteDomainTask(*task));
+        search_stats.packed_state_bytes = fdr->packed_bytes();
+        if(log_enabled(LOG_INFO))
+            cout<<"Finite-domain task: "<<fdr->variable_count()<<" variables packed into "<<fdr->packed_bytes()
+                <<" bytes per state ("<<task->atoms.size()<<" atoms)"<<endl;
+    }
+    const StateKeys state_keys(task,fdr.get(),symmetries.get());
+    unique_ptr<ActionTable> action_table;
+    vector<uint64_t> state_bits;
+    if(task)
+    {
+        action_table.reset(new ActionTable(*task));
+        state_bits.resize(action_table->words());
+    }
+    vector<int> candidate_actions;
+    vector<int> applicable_actions;
+    long long trial_applicable = 0, trial_pruned = 0;     //Over the stubborn set trial expansions
+    auto search_start = chrono::steady_clock::now();
+    TraceRecorder trace;
+    if(task && trace_this_query())
+        trace.open(trace_file,action_list);
+    const auto start_gc = env->get_initial_conditions();
+    const auto goal_gc = env->get_goal_conditions();
+    const vector<int> goal_atoms = task ? task->goal : vector<int>();
+    int node_count = 0;
+    StateGcostMap best_gcost;    //Lowest gcost seen for every generated state, keyed by canonical state
+    StateKeySet closed;
+    Node start_node{start_gc,0,node_count++};
+    if(task)
+    {
+        start_node.gc.clear();
+        start_node.packed = state_keys.pack(task->initial_state);
+    }
+    auto start_key = state_keys.key(start_node);
+    best_gcost[start_key] = 0;
+    open.push(start_node);
+    memory_accountant.reset_peak();
+    memory_accountant.charge(approximate_node_bytes(start_node) + string_heap_bytes(start_key));
+    bool beam_mode = false;
+    int goal_node = -1;
+    int loop_iteration_counter = 1;
+    while(!open.empty() && !search_cancelled())
+    {
+//        cout<<"Loop iteration counter "<<loop_iteration_counter<<endl;
+        const auto node_to_expand = open.top();
+        open.pop();
+        vector<int> atoms;
+        if(task)
+            atoms = state_keys.unpack(node_to_expand);
+        auto state_key = task ? state_keys.key(atoms) : search_state_key(node_to_expand.gc,state_keys);
+        if(closed.count(state_key) || node_to_expand.gcost>best_gcost[state_key])
+        {
+            memory_accountant.release(approximate_node_bytes(node_to_expand));
+            continue;       //Stale entry, this state was reached again with a lower gcost
+        }
+        closed.insert(state_key);
+        memory_accountant.charge(string_heap_bytes(state_key));
+        node_map.insert({node_to_expand.index_in_map,node_to_expand});     //Keeps the charge of its open list copy
+        if(trace.is_open())
+            trace.record(node_to_expand.index_in_map,node_to_expand.neighbors.empty() ? -1 : node_to_expand.neighbors[0],
+                         node_to_expand.action_index,node_to_expand.gcost,node_to_expand.hcost);
+        if(log_enabled(LOG_DEBUG))
+        {
+            cout<<"--------------------------"<<endl;
+            node_to_expand.print_node();
+            for(int atom:atoms)
+                cout<<task->atoms[atom]<<"\t";
+            if(task)
+                cout<<endl;
+        }
+        if(task ? task->satisfies(atoms,task->goal) : are_all_elements_present_in_collection(goal_gc,node_to_expand.gc))
+            {
+                if(log_enabled(LOG_INFO))
+                    cout<<"Goal has been found"<<endl;
+                goal_node = node_to_expand.index_in_map;
+                break;
+            }
+        if(lifted)
+        {
+            lifted_actions = lifted->applicable_actions(node_to_expand.gc);
+            candidate_actions.resize(lifted_actions.size());
+            for(int a=0;a<(int)lifted_actions.size();a++)
+                candidate_actions[a] = a;
+        }
+        else if(stubborn_sets)
+        {
+            stubborn_sets->compute(atoms,candidate_actions);
+            if(loop_iteration_counter<=stubborn_trial_expansions)
+            {
+                // Only the trial pays for the full applicability scan that the pruned count needs
+                action_table->state_bits(atoms,state_bits.data());
+                action_table->applicable_actions(state_bits.data(),applicable_actions);
+                long long pruned = applicable_actions.size()-candidate_actions.size();
+                search_stats.pruned_actions += pruned;
+                trial_applicable += applicable_actions.size();
+                trial_pruned += pruned;
+                // Computing the sets costs more than the pruning saves when it prunes (almost) nothing
+                if(loop_iteration_counter==stubborn_trial_expansions &&
+                   trial_pruned<stubborn_min_pruned_ratio*trial_applicable)
+                {
+                    stubborn_sets.reset();
+                    search_stats.stubborn_disabled_at = stubborn_trial_expansions;
+                    if(log_enabled(LOG_INFO))
+                        cout<<"Stubborn sets pruned "<<trial_pruned<<" of "<<trial_applicable<<" applicable actions in "
+                            <<stubborn_trial_expansions<<" expansions, disabled"<<endl;
+                }
+            }
+        }
+        else
+        {
+            action_table->state_bits(atoms,state_bits.data());
+            action_table->applicable_actions(state_bits.data(),candidate_actions);
+        }
+        expand_state(node_to_expand,atoms,action_list,open,node_count,goal_gc,best_gcost,closed,candidate_actions,state_keys,
+                     beam_mode,goal_atoms);
+        search_stats.expansions++;
+        loop_iteration_counter++;
+        if(beam_mode && open.size()>2*memory_beam_width)
+            open.trim(memory_beam_width);
+        if(memory_limit_bytes && memory_accountant.bytes_in_use()>memory_limit_bytes)
+        {
+            // Degrade according to memory_policy. Eviction has to bring usage well below the limit, otherwise every
+            // following expansion would trigger another one.
+            bool recovered = false;
+            if(memory_policy!=MEMORY_STOP)
+            {
+                if(memory_policy==MEMORY_BEAM)
+                {
+                    beam_mode = true;
+                    open.trim(memory_beam_width);
+                }
+                evict_search_memory(node_map,open,best_gcost,closed,state_keys);
+                search_stats.memory_evictions++;
+                recovered = memory_accountant.bytes_in_use()<=memory_limit_bytes/10*9;
+                if(log_enabled(LOG_INFO))
+                    cout<<"Memory limit reached, evicted down to "<<memory_accountant.bytes_in_use()<<" bytes"
+                        <<(beam_mode ? ", continuing as beam search" : "")<<endl;
+            }
+            if(!recovered)
+            {
+                cerr<<"out of memory"<<endl;
+                search_stats.out_of_memory = true;
+                break;
+            }
+        }
+    }
+    search_stats.search_seconds = seconds_since(search_start);
+    search_stats.memory_peak_bytes = max(search_stats.memory_peak_bytes,memory_accountant.peak_bytes());
+    trace.close();
+
+    if(goal_node!=-1)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        auto backtrack_start = chrono::steady_clock::now();
+        actions = back_track(goal_node,node_map,std::move(actions),start_gc,action_list);
+        search_stats.backtrack_seconds = seconds_since(backtrack_start);
+        search_stats.solved = true;
+        search_stats.plan_length = actions.size();
+    }
+    else if(log_enabled(LOG_INFO))
+        cout<<"PATH NOT FOUND"<<endl;
+
+    release_search_memory(node_map,open,best_gcost,closed);
+    return actions;
+
+    /// Use the index_in_map to backtrack. Keep selecting parents with lower gcost while backtracking
+}
+
+//=====================================================================================================================
+
+// Node of the searches over GroundedTask. For regression the state is a partial state (a set of subgoals).
+struct TaskNode
+{
+    vector<int> state;
+    int parent;
+    int action;
+    double gcost;
+};
+
+typedef priority_queue<pair<double,int>, vector<pair<double,int>>, greater<pair<double,int>>> TaskOpenList;
+
+//=====================================================================================================================
+
+vector<int> task_path_actions(const vector<TaskNode> &nodes, int node)
+{
+    vector<int> path;
+    for(;nodes[node].parent!=-1;node=nodes[node].parent)
+        path.push_back(nodes[node].action);
+    return path;    //Last action first
+}
+
+//=====================================================================================================================
+
+// Records the expansion of nodes[node_id]. Searches that trace two node vectors into one file keep their ids apart
+// with id_offset.
+void trace_task_node(TraceRecorder &trace, const vector<TaskNode> &nodes, int node_id, double hcost, int id_offset = 0)
+{
+    if(!trace.is_open())
+        return;
+    const auto &node = nodes[node_id];
+    trace.record(id_offset+node_id,node.parent==-1 ? -1 : id_offset+node.parent,node.action,node.gcost,hcost);
+}
+
+//=====================================================================================================================
+
+// Regression of subgoal through action: relevant when the action adds one of the subgoals and deletes none of the
+// subgoals it does not add. The regressed subgoal is (subgoal - add) + precondition.
+bool regress(const GroundedTask &task, const vector<int> &subgoal, int action, vector<int> &regressed)
+{
+    const auto &adds = task.add_effects[action];
+    const auto &deletes = task.delete_effects[action];
+    vector<int> untouched;
+    set_difference(subgoal.begin(),subgoal.end(),adds.begin(),adds.end(),back_inserter(untouched));
+    if(untouched.size()==subgoal.size())
+        return false;
+    vector<int> deleted;
+    set_intersection(untouched.begin(),untouched.end(),deletes.begin(),deletes.end(),back_inserter(deleted));
+    if(!deleted.empty())
+        return false;
+    regressed.clear();
+    set_union(untouched.begin(),untouched.end(),task.preconditions[action].begin(),task.preconditions[action].end(),
+              back_inserter(regressed));
+    return true;
+}
+
+//=====================================================================================================================
+
+// Atoms that no action adds or deletes keep their initial truth value, so a subgoal that needs one of them false in
+// the initial state can never be reached.
+vector<bool> find_static_atoms(const GroundedTask &task)
+{
+    vector<bool> is_static(task.atoms.size(),true);
+    for(size_t a=0;a<task.actions.size();a++)
+    {
+        for(int atom:task.add_effects[a])
+            is_static[atom] = false;
+        for(int atom:task.delete_effects[a])
+            is_static[atom] = false;
+    }
+    return is_static;
+}
+
+bool is_dead_subgoal(const GroundedTask &task, const vector<bool> &is_static, const vector<int> &subgoal)
+{
+    for(int atom:subgoal)
+        if(is_static[atom] && !binary_search(task.initial_state.begin(),task.initial_state.end(),atom))
+            return true;
+    return task.has_mutex(subgoal);
+}
+
+//=====================================================================================================================
+
+void regression_successors(const GroundedTask &task, const vector<bool> &is_static, const TaskNode &node,
+                           vector<pair<int,vector<int>>> &successors)
+{
+    successors.clear();
+    vector<int> regressed;
+    for(int action=0;action<(int)task.actions.size();action++)
+    {
+        if(!regress(task,node.state,action,regressed) || is_dead_subgoal(task,is_static,regressed))
+            continue;
+        successors.emplace_back(action,regressed);
+    }
+}
+
+//=====================================================================================================================
+
+list<GroundedAction> regression_planner(const GroundedTask &task)
+{
+    auto search_start = chrono::steady_clock::now();
+    const auto is_static = find_static_atoms(task);
+
+    vector<TaskNode> nodes{TaskNode{task.goal,-1,-1,0}};
+    unordered_map<vector<int>,double,AtomStateHasher> best_gcost{{task.goal,0}};
+    unordered_set<vector<int>,AtomStateHasher> closed;
+    TaskOpenList open;
+    open.push({0,0});
+    int goal_node = -1;
+    vector<pair<int,vector<int>>> successors;
+    TraceRecorder trace;
+    if(trace_this_query())
+        trace.open(trace_file,task.actions);
+
+    while(!open.empty() && !search_cancelled())
+    {
+        int node_id = open.top().second;
+        open.pop();
+        if(closed.count(nodes[node_id].state) || nodes[node_id].gcost>best_gcost[nodes[node_id].state])
+            continue;
+        closed.insert(nodes[node_id].state);
+        trace_task_node(trace,nodes,node_id,0);
+        if(task.satisfies(task.initial_state,nodes[node_id].state))
+        {
+            goal_node = node_id;
+            break;
+        }
+
+        regression_successors(task,is_static,nodes[node_id],successors);
+        search_stats.expansions++;
+        for(auto &successor:successors)
+        {
+            search_stats.generations++;
+            double new_g_cost = nodes[node_id].gcost+1;
+            auto best = best_gcost.find(successor.second);
+            if(best!=best_gcost.end() && best->second<=new_g_cost)
+            {
+                search_stats.duplicates++;
+                continue;
+            }
+            if(closed.erase(successor.second))
+                search_stats.reopenings++;
+            best_gcost[successor.second] = new_g_cost;
+            nodes.push_back(TaskNode{std::move(successor.second),node_id,successor.first,new_g_cost});
+            open.push({new_g_cost,(int)nodes.size()-1});
+        }
+        search_stats.open_peak = max(search_stats.open_peak,open.size());
+    }
+    search_stats.search_seconds = seconds_since(search_start);
+    trace.close();
+
+    list<GroundedAction> actions;
+    if(goal_node!=-1)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        // Walking up from the node that holds in the initial state gives the actions in execution order
+        auto path = task_path_actions(nodes,goal_node);
+        actions = task.to_plan(path);
+        search_stats.solved = true;
+        search_stats.plan_length = actions.size();
+    }
+    else if(log_enabled(LOG_INFO))
+        cout<<"PATH NOT FOUND"<<endl;
+    return actions;
+}
+
+//=====================================================================================================================
+
+// Front-to-front bidirectional uniform cost search. The forward half searches complete states from the initial state,
+// the backward half regresses subgoals from the goal, and the frontiers meet when a forward state satisfies a
+// backward subgoal. The search stops once no cheaper meeting point can exist, so plans stay optimal. Both halves are
+// traced into one file, the backward node ids offset by bidirectional_trace_offset.
+const int bidirectional_trace_offset = 1 << 30;
+
+list<GroundedAction> bidirectional_planner(const GroundedTask &task)
+{
+    auto search_start = chrono::steady_clock::now();
+    const auto is_static = find_static_atoms(task);
+
+    vector<TaskNode> forward_nodes{TaskNode{task.initial_state,-1,-1,0}};
+    vector<TaskNode> backward_nodes{TaskNode{task.goal,-1,-1,0}};
+    unordered_map<vector<int>,double,AtomStateHasher> forward_best{{task.initial_state,0}};
+    unordered_map<vector<int>,double,AtomStateHasher> backward_best{{task.goal,0}};
+    TaskOpenList forward_open, backward_open;
+    forward_open.push({0,0});
+    backward_open.push({0,0});
+
+    double best_plan_cost = numeric_limits<double>::infinity();
+    int meet_forward = -1, meet_backward = -1;
+    auto check_meeting = [&](int forward_id, int backward_id)
+    {
+        double cost = forward_nodes[forward_id].gcost + backward_nodes[backward_id].gcost;
+        if(cost<best_plan_cost && task.satisfies(forward_nodes[forward_id].state,backward_nodes[backward_id].state))
+        {
+            best_plan_cost = cost;
+            meet_forward = forward_id;
+            meet_backward = backward_id;
+        }
+    };
+
+    // Meeting points are found through atom indexes instead of comparing against every node of the other half. Every
+    // forward node is filed under each atom of its state, and every backward node under one atom of its subgoal, the
+    // one with the fewest backward nodes so far. A forward state then only meets the subgoals filed under its atoms,
+    // and a subgoal only the forward states that hold its atom with the shortest list.
+    vector<vector<int>> forward_by_atom(task.atoms.size());
+    vector<vector<int>> backward_by_atom(task.atoms.size());
+    vector<int> empty_subgoals;
+    auto add_forward = [&](int forward_id)
+    {
+        for(int atom:forward_nodes[forward_id].state)
+        {
+            forward_by_atom[atom].push_back(forward_id);
+            for(int backward_id:backward_by_atom[atom])
+                check_meeting(forward_id,backward_id);
+        }
+        for(int backward_id:empty_subgoals)
+            check_meeting(forward_id,backward_id);
+    };
+    auto add_backward = [&](int backward_id)
+    {
+        const auto &subgoal = backward_nodes[backward_id].state;
+        if(subgoal.empty())
+        {
+            empty_subgoals.push_back(backward_id);
+            for(int forward_id=0;forward_id<(int)forward_nodes.size();forward_id++)
+                check_meeting(forward_id,backward_id);
+            return;
+        }
+        int filed = subgoal[0], rarest = subgoal[0];
+        for(int atom:subgoal)
+        {
+            if(backward_by_atom[atom].size()<backward_by_atom[filed].size())
+                filed = atom;
+            if(forward_by_atom[atom].size()<forward_by_atom[rarest].size())
+                rarest = atom;
+        }
+        backward_by_atom[filed].push_back(backward_id);
+        for(int forward_id:forward_by_atom[rarest])
+            check_meeting(forward_id,backward_id);
+    };
+    add_forward(0);
+    add_backward(0);
+
+    const ActionTable action_table(task);
+    vector<uint64_t> state_bits(action_table.words());
+    vector<int> applicable;
+    vector<pair<int,vector<int>>> successors;
+    TraceRecorder trace;
+    if(trace_this_query())
+        trace.open(trace_file,task.actions);
+    while(!forward_open.empty() && !backward_open.empty() && !search_cancelled())
+    {
+        if(forward_open.top().first+backward_open.top().first+1>best_plan_cost)
+            break;
+
+        bool forward = forward_open.size()<=backward_open.size();
+        auto &open = forward ? forward_open : backward_open;
+        auto &nodes = forward ? forward_nodes : backward_nodes;
+        auto &best_gcost = forward ? forward_best : backward_best;
+
+        int node_id = open.top().second;
+        open.pop();
+        if(nodes[node_id].gcost>best_gcost[nodes[node_id].state])
+            continue;
+        trace_task_node(trace,nodes,node_id,0,forward ? 0 : bidirectional_trace_offset);
+
+        successors.clear();
+        if(forward)
+        {
+            action_table.state_bits(nodes[node_id].state,state_bits.data());
+            action_table.applicable_actions(state_bits.data(),applicable);
+            for(int action:applicable)
+                successors.emplace_back(action,task.apply(nodes[node_id].state,action));
+        }
+        else
+            regression_successors(task,is_static,nodes[node_id],successors);
+        search_stats.expansions++;
+
+        for(auto &successor:successors)
+        {
+            search_stats.generations++;
+            double new_g_cost = nodes[node_id].gcost+1;
+            auto best = best_gcost.find(successor.second);
+            if(best!=best_gcost.end() && best->second<=new_g_cost)
+            {
+                search_stats.duplicates++;
+                continue;
+            }
+            best_gcost[successor.second] = new_g_cost;
+            nodes.push_back(TaskNode{std::move(successor.second),node_id,successor.first,new_g_cost});
+            int new_id = nodes.size()-1;
+            open.push({new_g_cost,new_id});
+
+            if(forward)
+                add_forward(new_id);
+            else
+                add_backward(new_id);
+        }
+        search_stats.open_peak = max(search_stats.open_peak,forward_open.size()+backward_open.size());
+    }
+    search_stats.search_seconds = seconds_since(search_start);
+    trace.close();
+
+    list<GroundedAction> actions;
+    if(meet_forward!=-1)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        auto forward_path = task_path_actions(forward_nodes,meet_forward);
+        reverse(forward_path.begin(),forward_path.end());
+        auto backward_path = task_path_actions(backward_nodes,meet_backward);
+        forward_path.insert(forward_path.end(),backward_path.begin(),backward_path.end());
+        actions = task.to_plan(forward_path);
+        search_stats.solved = true;
+        search_stats.plan_length = actions.size();
+    }
+    else if(log_enabled(LOG_INFO))
+        cout<<"PATH NOT FOUND"<<endl;
+    return actions;
+}
+
+//=====================================================================================================================
+
+// Fixed-capacity transposition table for IDA*. Each slot remembers, for one state hash, the smallest g at which the
+// state was entered in the current iteration and a lower bound on its cost to go learned from earlier iterations.
+// A slot is overwritten when it is empty, belongs to an older iteration, holds the same state, or holds the state at a
+// larger g; entries at small g guard larger subtrees and are kept in preference.
+class TranspositionTable
+{
+private:
+    struct Entry
+    {
+        uint64_t key;
+        int32_t gcost;
+        int32_t iteration;
+        double learned_h;
+    };
+    vector<Entry> slots;
+    uint64_t mask;
+
+public:
+    TranspositionTable(size_t capacity)
+    {
+        size_t size = 1;
+        while(size*2<=max<size_t>(capacity,1))
+            size *= 2;
+        this->slots.assign(size,Entry{0,-1,-1,0});
+        this->mask = size-1;
+    }
+
+    // True when the state was already entered at a g no larger than gcost during this iteration.
+    bool seen(uint64_t key, int gcost, int iteration) const
+    {
+        const Entry &entry = this->slots[key & this->mask];
+        return entry.key==key && entry.iteration==iteration && entry.gcost<=gcost;
+    }
+
+    double learned_h(uint64_t key) const
+    {
+        const Entry &entry = this->slots[key & this->mask];
+        return entry.key==key && entry.gcost>=0 ? entry.learned_h : 0;
+    }
+
+    void store_visit(uint64_t key, int gcost, int iteration)
+    {
+        Entry &entry = this->slots[key & this->mask];
+        if(entry.gcost<0 || entry.key==key || entry.iteration!=iteration || gcost<entry.gcost)
+        {
+            double learned = entry.key==key ? entry.learned_h : 0;
+            entry = Entry{key,gcost,iteration,learned};
+        }
+    }
+
+    void store_learned_h(uint64_t key, double learned_h)
+    {
+        Entry &entry = this->slots[key & this->mask];
+        if(entry.key==key)
+            entry.learned_h = max(entry.learned_h,learned_h);
+    }
+};
+
+//=====================================================================================================================
+
+// IDA* over the grounded task. The state is a single atom bit set that actions modify in place and undo on
+// backtracking, with a Zobrist hash maintained alongside, so memory is the search path plus the transposition table.
+// The applicable actions of a node come from an ActionTable scan of the bit set.
+class IDAStarSearch
+{
+private:
+    const GroundedTask &task;
+    const ActionTable actions;
+    vector<uint64_t> holds;
+    vector<uint64_t> zobrist;
+    uint64_t hash = 0;
+    TranspositionTable table;
+    vector<int> path;
+    int iteration = 0;
+    double bound = 0;
+
+    bool holds_atom(int atom) const
+    {
+        return (this->holds[atom/64] >> (atom%64)) & 1;
+    }
+
+    void flip_atom(int atom)
+    {
+        this->holds[atom/64] ^= (uint64_t)1 << (atom%64);
+        this->hash ^= this->zobrist[atom];
+    }
+
+    // Atoms whose value was flipped are recorded in undo, flipping them again restores the state
+    void set_atom(int atom, bool value, vector<int> &undo)
+    {
+        if(this->holds_atom(atom)==value)
+            return;
+        undo.push_back(atom);
+        this->flip_atom(atom);
+    }
+
+    bool is_goal() const
+    {
+        for(int atom:this->task.goal)
+            if(!this->holds_atom(atom))
+                return false;
+        return true;
+    }
+
+    double heuristic() const
+    {
+        return 0;       //Same as Node::calculate_hcost
+    }
+
+    // Returns -1 when a plan was found below this node, otherwise the smallest f that exceeded the bound.
+    double depth_first(int gcost)
+    {
+        double h = max(this->heuristic(),this->table.learned_h(this->hash));
+        double f = gcost + h;
+        if(f>this->bound)
+            return f;
+        if(this->is_goal())
+            return -1;
+        if(search_cancelled())
+            return numeric_limits<double>::infinity();
+        if(this->table.seen(this->hash,gcost,this->iteration))
+        {
+            search_stats.duplicates++;
+            return numeric_limits<double>::infinity();
+        }
+        this->table.store_visit(this->hash,gcost,this->iteration);
+        search_stats.expansions++;
+        long long prunes_before = search_stats.duplicates;
+
+        double next_bound = numeric_limits<double>::infinity();
+        vector<int> undo;
+        vector<int> applicable;
+        this->actions.applicable_actions(this->holds.data(),applicable);
+        for(int action:applicable)
+        {
+            search_stats.generations++;
+            for(int atom:this->actions.delete_effects(action))
+                this->set_atom(atom,false,undo);
+            for(int atom:this->actions.add_effects(action))
+                this->set_atom(atom,true,undo);
+            this->path.push_back(action);
+
+            double t = this->depth_first(gcost+1);
+            if(t<0)
+                return -1;
+            next_bound = min(next_bound,t);
+
+            this->path.pop_back();
+            for(int atom:undo)
+                this->flip_atom(atom);
+            undo.clear();
+        }
+        // A subtree cut short by the table may report too large a bound, so only complete subtrees teach h
+        if(search_stats.duplicates==prunes_before)
+            this->table.store_learned_h(this->hash,next_bound-gcost);
+        return next_bound;
+    }
+
+public:
+    IDAStarSearch(const GroundedTask &task, size_t table_capacity): task(task),actions(task),table(table_capacity)
+    {
+        mt19937_64 random_keys(0x5eed);
+        this->zobrist.resize(task.atoms.size());
+        for(auto &key:this->zobrist)
+            key = random_keys();
+        this->holds.assign(this->actions.words(),0);
+        for(int atom:task.initial_state)
+            this->flip_atom(atom);
+    }
+
+    bool search(vector<int> &plan)
+    {
+        this->bound = this->heuristic();
+        while(true)
+        {
+            if(log_enabled(LOG_INFO))
+                cout<<"IDA* iteration "<<this->iteration<<" with f bound "<<this->bound<<endl;
+            double t = this->depth_first(0);
+            if(t<0)
+            {
+                plan = this->path;
+                return true;
+            }
+            if(t==numeric_limits<double>::infinity())
+                return false;
+            this->bound = t;
+            this->iteration++;
+        }
+    }
+};
+
+//=====================================================================================================================
+
+list<GroundedAction> idastar_planner(const GroundedTask &task)
+{
+    auto search_start = chrono::steady_clock::now();
+    IDAStarSearch search(task,transposition_table_size);
+    vector<int> plan;
+    bool found = search.search(plan);
+    search_stats.search_seconds = seconds_since(search_start);
+
+    list<GroundedAction> actions;
+    if(found)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        actions = task.to_plan(plan);
+        search_stats.solved = true;
+        search_stats.plan_length = actions.size();
+    }
+    else if(log_enabled(LOG_INFO))
+        cout<<"PATH NOT FOUND"<<endl;
+    return actions;
+}
+
+//=====================================================================================================================
+
+// External-memory breadth-first search with delayed duplicate detection. Every layer lives on disk as a sorted file of
+// fixed-size records: the state packed into its finite-domain variables, followed by the id of the action that generated it.
+// Successors are collected in a buffer bounded by external_memory_budget; a full buffer is sorted, deduplicated and
+// written out as a run. At the end of a layer the runs are merged and every state that also appears in an earlier
+// layer is dropped, so RAM use depends on the budget and not on the size of the state space. With the zero heuristic
+// of Node::calculate_hcost and unit action costs this expands states in the same order as A*.
+//
+// When every action can be undone by another one the state space is undirected, and a successor of layer d can only
+// be a duplicate of a state in layer d or d-1, so only those two layers are read while merging. Otherwise the merge
+// reads one sorted file of every state visited so far, and each finished layer is merged into it.
+class ExternalSearch
+{
+private:
+    const GroundedTask &task;
+    const FiniteDomainTask fdr;
+    const ActionTable actions;
+    string directory;
+    size_t state_bytes;
+    size_t record_bytes;
+    size_t buffer_capacity;         //Records that fit in the memory budget
+    bool reversible;                //Only the previous two layers can hold duplicates
+    string visited_file;            //All states of the layers so far, when not reversible
+    vector<string> layer_files;
+    vector<string> runs;            //Runs of the layer being expanded
+    int file_counter = 0;
+    static const size_t max_merge_fan_in = 256;
+
+    class RecordReader
+    {
+    private:
+        FILE* file;
+        size_t record_bytes;
+    public:
+        vector<unsigned char> record;
+        bool valid = false;
+
+        RecordReader(const string &path, size_t record_bytes): record_bytes(record_bytes),record(record_bytes)
+        {
+            this->file = fopen(path.c_str(),"rb");
+            this->advance();
+        }
+        ~RecordReader()
+        {
+            if(this->file)
+                fclose(this->file);
+        }
+        void advance()
+        {
+            this->valid = this->file && fread(this->record.data(),1,this->record_bytes,this->file)==this->record_bytes;
+        }
+    };
+
+    string new_file_name(const string &prefix)
+    {
+        return this->directory + "/" + prefix + to_string(this->file_counter++) + ".bin";
+    }
+
+    void pack(const vector<int> &state, unsigned char* out) const
+    {
+        this->fdr.pack(state,out);
+    }
+
+    vector<int> unpack(const unsigned char* in) const
+    {
+        return this->fdr.unpack(in);
+    }
+
+    int record_action(const unsigned char* record) const
+    {
+        int32_t action;
+        memcpy(&action,record+this->state_bytes,sizeof(action));
+        return action;
+    }
+
+    int compare_states(const unsigned char* a, const unsigned char* b) const
+    {
+        return memcmp(a,b,this->state_bytes);
+    }
+
+    // True when b takes every state in which a is applicable back to itself after a. b has to be applicable after a,
+    // given the static atoms that always hold. The atoms a deletes must be preconditions of a, so they were true, and b
+    // must add them back and add nothing that was false. b must delete exactly the atoms a added that were false
+    // before, which are known only when they are h^2 mutex with a precondition of a.
+    bool undoes(int a, int b, const vector<bool> &always_true) const
+    {
+        const auto &pre = this->task.preconditions[a];
+        const auto &add = this->task.add_effects[a];
+        const auto &del = this->task.delete_effects[a];
+        auto contains = [](const vector<int> &atoms, int atom) { return binary_search(atoms.begin(),atoms.end(),atom); };
+        for(int atom:this->task.preconditions[b])
+            if(contains(del,atom) || (!contains(pre,atom) && !contains(add,atom) && !always_true[atom]))
+                return false;
+        for(int atom:del)
+            if(!contains(this->task.add_effects[b],atom))
+                return false;
+        for(int atom:this->task.add_effects[b])
+            if(!contains(pre,atom))
+                return false;
+        for(int atom:add)
+        {
+            if(contains(pre,atom))
+                continue;
+            vector<int> with_atom = pre;
+            with_atom.push_back(atom);
+            if(!contains(this->task.delete_effects[b],atom) || contains(this->task.add_effects[b],atom)
+               || !this->task.has_mutex(with_atom))
+                return false;
+        }
+        for(int atom:this->task.delete_effects[b])
+            if((contains(pre,atom) || !contains(add,atom)) && !contains(this->task.add_effects[b],atom))
+                return false;
+        return true;
+    }
+
+    bool all_actions_reversible() const
+    {
+        if(this->task.h2_reachable.empty())
+            return false;
+        vector<bool> always_true = find_static_atoms(this->task);
+        for(int atom=0;atom<(int)this->task.atoms.size();atom++)
+            always_true[atom] = always_true[atom] && binary_search(this->task.initial_state.begin(),
+                                                                   this->task.initial_state.end(),atom);
+        vector<vector<int>> adders(this->task.atoms.size()), deleters(this->task.atoms.size());
+        for(int b=0;b<(int)this->task.actions.size();b++)
+        {
+            for(int atom:this->task.add_effects[b])
+                adders[atom].push_back(b);
+            for(int atom:this->task.delete_effects[b])
+                deleters[atom].push_back(b);
+        }
+        for(int a=0;a<(int)this->task.actions.size();a++)
+        {
+            // An inverse adds back what a deletes, or else deletes what a adds
+            const auto &pre = this->task.preconditions[a];
+            const vector<int>* candidates = nullptr;
+            if(!this->task.delete_effects[a].empty())
+                candidates = &adders[this->task.delete_effects[a][0]];
+            for(int atom:this->task.add_effects[a])
+                if(!candidates && !binary_search(pre.begin(),pre.end(),atom))
+                    candidates = &deleters[atom];
+            if(!candidates)
+                continue;       //Changes nothing
+            bool reversible = false;
+            for(size_t i=0;i<candidates->size() && !reversible;i++)
+                reversible = this->undoes(a,(*candidates)[i],always_true);
+            if(!reversible)
+                return false;
+        }
+        return true;
+    }
+
+    // Sorts the buffered records by state, keeps one record per state and writes them as a run file.
+    void write_run(const vector<unsigned char> &buffer)
+    {
+        size_t count = buffer.size()/this->record_bytes;
+        vector<size_t> order(count);
+        for(size_t i=0;i<count;i++)
+            order[i] = i;
+        const unsigned char* base = buffer.data();
+        sort(order.begin(),order.end(),[&](size_t a, size_t b)
+        {
+            return this->compare_states(base+a*this->record_bytes,base+b*this->record_bytes)<0;
+        });
+        string run = this->new_file_name("run");
+        FILE* file = fopen(run.c_str(),"wb");
+        if(!file)
+            throw runtime_error("Unable to write " + run);
+        const unsigned char* previous = nullptr;
+        for(size_t i:order)
+        {
+            const unsigned char* record = base+i*this->record_bytes;
+            if(previous && this->compare_states(previous,record)==0)
+            {
+                search_stats.duplicates++;
+                continue;
+            }
+            fwrite(record,1,this->record_bytes,file);
+            previous = record;
+        }
+        fclose(file);
+        this->runs.push_back(run);
+    }
+
+    // Files a new layer is checked against: the last two layers, or the visited states
+    vector<string> earlier_states() const
+    {
+        if(!this->reversible)
+            return vector<string>{this->visited_file};
+        size_t first = this->layer_files.size()-min<size_t>(2,this->layer_files.size());
+        return vector<string>(this->layer_files.begin()+first,this->layer_files.end());
+    }
+
+    // Merges sorted run files into output, keeping one record per state. With subtract_layers set, states that appear
+    // in earlier_states() are dropped as well. Returns the number of records written.
+    size_t merge_files(const vector<string> &inputs, const string &output, bool subtract_layers)
+    {
+        vector<unique_ptr<RecordReader>> run_readers, layer_readers;
+        for(const auto &input:inputs)
+            run_readers.emplace_back(new RecordReader(input,this->record_bytes));
+        if(subtract_layers)
+            for(const auto &earlier:this->earlier_states())
+                layer_readers.emplace_back(new RecordReader(earlier,this->record_bytes));
+
+        auto greater_state = [&](RecordReader* a, RecordReader* b)
+        {
+            return this->compare_states(a->record.data(),b->record.data())>0;
+        };
+        priority_queue<RecordReader*, vector<RecordReader*>, decltype(greater_state)> heap(greater_state);
+        for(auto &reader:run_readers)
+            if(reader->valid)
+                heap.push(reader.get());
+
+        FILE* file = fopen(output.c_str(),"wb");
+        if(!file)
+            throw runtime_error("Unable to write " + output);
+        size_t written = 0;
+        vector<unsigned char> last(this->record_bytes);
+        bool have_last = false;
+        while(!heap.empty())
+        {
+            RecordReader* reader = heap.top();
+            heap.pop();
+            const unsigned char* record = reader->record.data();
+            bool duplicate = have_last && this->compare_states(last.data(),record)==0;
+            if(!duplicate)
+            {
+                // Earlier layers are sorted too, so advancing them alongside the merge is a single linear pass
+                for(auto &layer:layer_readers)
+                {
+                    while(layer->valid && this->compare_states(layer->record.data(),record)<0)
+                        layer->advance();
+                    if(layer->valid && this->compare_states(layer->record.data(),record)==0)
+                        duplicate = true;
+                }
+            }
+            if(duplicate)
+                search_stats.duplicates++;
+            else
+            {
+                fwrite(record,1,this->record_bytes,file);
+                memcpy(last.data(),record,this->record_bytes);
+                have_last = true;
+                written++;
+            }
+            reader->advance();
+            if(reader->valid)
+                heap.push(reader);
+        }
+        fclose(file);
+        run_readers.clear();
+        for(const auto &input:inputs)
+            remove(input.c_str());
+        return written;
+    }
+
+    // Merges the runs of the current layer into the next layer file, in several passes when there are more runs than
+    // files we want open at once.
+    size_t merge_runs(const string &layer_file)
+    {
+        while(this->runs.size()+this->earlier_states().size()>max_merge_fan_in)
+        {
+            size_t fan_in = max<size_t>(max_merge_fan_in/2,2);
+            vector<string> group(this->runs.begin(),this->runs.begin()+min(fan_in,this->runs.size()));
+            vector<string> rest(this->runs.begin()+group.size(),this->runs.end());
+            string merged = this->new_file_name("run");
+            this->runs = rest;
+            this->merge_files(group,merged,false);
+            this->runs.push_back(merged);
+            if(group.size()<2)
+                break;
+        }
+        vector<string> inputs;
+        inputs.swap(this->runs);
+        return this->merge_files(inputs,layer_file,true);
+    }
+
+    // Merges a finished layer, which holds no visited state, into a new visited file that replaces the old one.
+    void add_to_visited(const string &layer_file)
+    {
+        string visited = this->new_file_name("visited");
+        FILE* file = fopen(visited.c_str(),"wb");
+        if(!file)
+            throw runtime_error("Unable to write " + visited);
+        RecordReader old_states(this->visited_file,this->record_bytes), new_states(layer_file,this->record_bytes);
+        while(old_states.valid || new_states.valid)
+        {
+            bool take_old = old_states.valid && (!new_states.valid ||
+                                                 this->compare_states(old_states.record.data(),new_states.record.data())<0);
+            RecordReader &reader = take_old ? old_states : new_states;
+            fwrite(reader.record.data(),1,this->record_bytes,file);
+            reader.advance();
+        }
+        fclose(file);
+        if(!this->visited_file.empty())
+            remove(this->visited_file.c_str());
+        this->visited_file = visited;
+    }
+
+    // Walks back through the layers: the predecessor of a record is the state in the previous layer from which its
+    // action leads to it.
+    vector<int> reconstruct(vector<unsigned char> record, int depth) const
+    {
+        vector<int> plan;
+        for(int layer=depth;layer>0;layer--)
+        {
+            int action = this->record_action(record.data());
+            plan.push_back(action);
+            auto target = this->unpack(record.data());
+            RecordReader reader(this->layer_files[layer-1],this->record_bytes);
+            bool found = false;
+            for(;reader.valid && !found;reader.advance())
+            {
+                auto candidate = this->unpack(reader.record.data());
+                if(this->task.is_applicable(candidate,action) && this->task.apply(candidate,action)==target)
+                {
+                    record = reader.record;
+                    found = true;
+                }
+            }
+            if(!found)
+                throw runtime_error("External search could not find the predecessor of a layer " + to_string(layer) + " state");
+        }
+        reverse(plan.begin(),plan.end());
+        return plan;
+    }
+
+public:
+    ExternalSearch(const GroundedTask &task, const string &base_directory, size_t memory_budget): task(task),fdr(task),actions(task)
+    {
+        this->state_bytes = this->fdr.packed_bytes();
+        search_stats.packed_state_bytes = this->state_bytes;
+        this->record_bytes = this->state_bytes + sizeof(int32_t);
+        this->buffer_capacity = max<size_t>(memory_budget/this->record_bytes,1);
+        this->reversible = this->all_actions_reversible();
+        if(log_enabled(LOG_INFO))
+            cout<<"External search checks duplicates against "
+                <<(this->reversible ? string("the previous two layers") : string("all visited states"))<<endl;
+        string pattern = base_directory + "/planner_external_XXXXXX";
+        vector<char> name(pattern.begin(),pattern.end());
+        name.push_back('\0');
+        if(!mkdtemp(name.data()))
+            throw runtime_error("Unable to create a directory under " + base_directory);
+        this->directory = name.data();
+    }
+
+    ~ExternalSearch()
+    {
+        for(const auto &layer:this->layer_files)
+            remove(layer.c_str());
+        for(const auto &run:this->runs)
+            remove(run.c_str());
+        if(!this->visited_file.empty())
+            remove(this->visited_file.c_str());
+        rmdir(this->directory.c_str());
+    }
+
+    // Returns true with the plan when a goal is reached, false once a layer comes out empty (no plan exists).
+    bool search(vector<int> &plan)
+    {
+        string first_layer = this->new_file_name("layer");
+        {
+            vector<unsigned char> record(this->record_bytes);
+            this->pack(this->task.initial_state,record.data());
+            int32_t no_action = -1;
+            memcpy(record.data()+this->state_bytes,&no_action,sizeof(no_action));
+            FILE* file = fopen(first_layer.c_str(),"wb");
+            if(!file)
+                throw runtime_error("Unable to write " + first_layer);
+            fwrite(record.data(),1,this->record_bytes,file);
+            fclose(file);
+        }
+        this->layer_files.push_back(first_layer);
+        if(!this->reversible)
+            this->add_to_visited(first_layer);
+
+        // Only reserved: the pages of a large budget are touched as successors arrive, not zeroed up front
+        vector<unsigned char> buffer;
+        buffer.reserve(this->buffer_capacity*this->record_bytes);
+        for(int depth=0;;depth++)
+        {
+            vector<uint64_t> state_bits(this->actions.words());
+            vector<int> applicable;
+            RecordReader reader(this->layer_files[depth],this->record_bytes);
+            for(;reader.valid;reader.advance())
+            {
+                auto state = this->unpack(reader.record.data());
+                if(this->task.satisfies(state,this->task.goal))
+                {
+                    plan = this->reconstruct(reader.record,depth);
+                    return true;
+                }
+                if(search_cancelled())
+                    return false;
+                search_stats.expansions++;
+                this->actions.state_bits(state,state_bits.data());
+                this->actions.applicable_actions(state_bits.data(),applicable);
+                for(int action:applicable)
+                {
+                    search_stats.generations++;
+                    buffer.resize(buffer.size()+this->record_bytes);
+                    unsigned char* record = buffer.data()+buffer.size()-this->record_bytes;
+                    this->pack(this->task.apply(state,action),record);
+                    int32_t action_id = action;
+                    memcpy(record+this->state_bytes,&action_id,sizeof(action_id));
+                    if(buffer.size()==this->buffer_capacity*this->record_bytes)
+                    {
+                        this->write_run(buffer);
+                        buffer.clear();
+                    }
+                }
+            }
+            if(!buffer.empty())
+            {
+                this->write_run(buffer);
+                buffer.clear();
+            }
+
+            string next_layer = this->new_file_name("layer");
+            size_t layer_size = this->merge_runs(next_layer);
+            this->layer_files.push_back(next_layer);
+            if(!this->reversible)
+                this->add_to_visited(next_layer);
+            search_stats.open_peak = max(search_stats.open_peak,layer_size);
+            if(log_enabled(LOG_INFO))
+                cout<<"Layer "<<depth+1<<": "<<layer_size<<" new states"<<endl;
+            if(layer_size==0)
+                return false;
+        }
+    }
+};
+
+//=====================================================================================================================
+
+list<GroundedAction> external_planner(const GroundedTask &task)
+{
+    auto search_start = chrono::steady_clock::now();
+    vector<int> plan;
+    bool found;
+    {
+        ExternalSearch search(task,external_search_dir,external_memory_budget);
+        found = search.search(plan);
+    }
+    search_stats.search_seconds = seconds_since(search_start);
+
+    list<GroundedAction> actions;
+    if(found)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        actions = task.to_plan(plan);
+        search_stats.solved = true;
+        search_stats.plan_length = actions.size();
+    }
+    else if(log_enabled(LOG_INFO))
+        cout<<"PATH NOT FOUND (state space exhausted)"<<endl;
+    return actions;
+}
+//=====================================================================================================================
+
+// Novelty of a state with respect to the states recorded before it (Lipovetzky and Geffner). The novelty is 1 when the
+// state has an atom that no earlier state had, 2 when it has such an atom pair, and width+1 otherwise. Evaluating a
+// state also records its tuples. A table can be split into partitions whose tuples are recorded separately. Atom pairs
+// of all partitions go into one bit triangle per partition, or into one hash set keyed by partition and pair when the
+// triangles together would take more than novelty_dense_pair_bits.
+class NoveltyTable
+{
+private:
+    int width;
+    size_t atom_count;
+    uint64_t pair_count;
+    vector<char> seen_atoms;
+    bool dense_pairs;
+    vector<uint64_t> seen_pair_bits;
+    unordered_set<uint64_t> seen_pairs;
+
+    bool record_pair(int partition, int first, int second)
+    {
+        uint64_t low = min(first,second), high = max(first,second);
+        uint64_t index = partition*this->pair_count + high*(high-1)/2 + low;
+        if(!this->dense_pairs)
+            return this->seen_pairs.insert(index).second;
+        uint64_t bit = (uint64_t)1 << (index%64);
+        bool is_new = !(this->seen_pair_bits[index/64] & bit);
+        this->seen_pair_bits[index/64] |= bit;
+        return is_new;
+    }
+
+public:
+    NoveltyTable(size_t atom_count, int width, int partitions = 1): width(width),atom_count(atom_count),
+        seen_atoms(atom_count*partitions,0)
+    {
+        this->pair_count = (uint64_t)atom_count*(atom_count+1)/2;
+        uint64_t pairs = this->pair_count*partitions;
+        this->dense_pairs = width>=2 && pairs<=novelty_dense_pair_bits;
+        if(this->dense_pairs)
+            this->seen_pair_bits.assign(pairs/64+1,0);
+    }
+
+    // With added_atoms set, the caller guarantees that every tuple of the parent state has already been recorded in
+    // this table, so only the tuples that contain an atom the action added can be new.
+    int evaluate(const vector<int> &state, const vector<int>* added_atoms = nullptr, int partition = 0)
+    {
+        const vector<int> &new_atoms = added_atoms ? *added_atoms : state;
+        char* seen_atoms = this->seen_atoms.data() + partition*this->atom_count;
+        int novelty = this->width+1;
+        for(int atom:new_atoms)
+        {
+            if(!seen_atoms[atom])
+            {
+                seen_atoms[atom] = 1;
+                novelty = 1;
+            }
+        }
+        if(this->width<2)
+            return novelty;
+        for(size_t i=0;i<new_atoms.size();i++)
+        {
+            for(size_t j=0;j<state.size();j++)
+            {
+                // Without added_atoms both loops run over the state, so each pair is visited once from its larger atom
+                if(added_atoms ? new_atoms[i]==state[j] : state[j]>=new_atoms[i])
+                    continue;
+                if(this->record_pair(partition,new_atoms[i],state[j]) && novelty>2)
+                    novelty = 2;
+            }
+        }
+        return novelty;
+    }
+};
+
+//=====================================================================================================================
+
+int unsatisfied_goal_count(const GroundedTask &task, const vector<int> &state)
+{
+    int count = 0;
+    for(int atom:task.goal)
+        if(!binary_search(state.begin(),state.end(),atom))
+            count++;
+    return count;
+}
+
+//=====================================================================================================================
+
+// IW(width): breadth-first search that prunes every generated state whose novelty exceeds the width. IW(1) expands at
+// most one state per atom and IW(2) one per atom pair, so both run in polynomial time, but they are incomplete and
+// their plans are not optimal. Duplicate states have no new tuples and are pruned like any other stale state. Returns
+// the node id of a goal state, or -1.
+int iterated_width_search(const GroundedTask &task, const ActionTable &action_table, int width, vector<TaskNode> &nodes)
+{
+    nodes.assign(1,TaskNode{task.initial_state,-1,-1,0});
+    if(task.satisfies(task.initial_state,task.goal))
+        return 0;
+    NoveltyTable novelty(task.atoms.size(),width);
+    novelty.evaluate(task.initial_state);
+    queue<int> open;
+    open.push(0);
+    vector<uint64_t> state_bits(action_table.words());
+    vector<int> applicable;
+    while(!open.empty() && !search_cancelled())
+    {
+        int node_id = open.front();
+        open.pop();
+        search_stats.expansions++;
+        action_table.state_bits(nodes[node_id].state,state_bits.data());
+        action_table.applicable_actions(state_bits.data(),applicable);
+        for(int action:applicable)
+        {
+            search_stats.generations++;
+            auto successor = task.apply(nodes[node_id].state,action);
+            if(novelty.evaluate(successor,&task.add_effects[action])>width)
+            {
+                search_stats.novelty_pruned++;
+                continue;
+            }
+            nodes.push_back(TaskNode{std::move(successor),node_id,action,nodes[node_id].gcost+1});
+            if(task.satisfies(nodes.back().state,task.goal))
+                return nodes.size()-1;
+            open.push(nodes.size()-1);
+        }
+        search_stats.open_peak = max(search_stats.open_peak,open.size());
+    }
+    return -1;
+}
+
+//=====================================================================================================================
+
+list<GroundedAction> iw_planner(const GroundedTask &task)
+{
+    auto search_start = chrono::steady_clock::now();
+    const ActionTable action_table(task);
+    vector<TaskNode> nodes;
+    int goal_node = -1;
+    for(int width=1;width<=novelty_max_width && goal_node==-1 && !search_cancelled();width++)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"IW("<<width<<")"<<endl;
+        goal_node = iterated_width_search(task,action_table,width,nodes);
+        search_stats.novelty_width = width;
+    }
+    search_stats.search_seconds = seconds_since(search_start);
+
+    list<GroundedAction> actions;
+    if(goal_node!=-1)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        auto path = task_path_actions(nodes,goal_node);
+        reverse(path.begin(),path.end());
+        actions = task.to_plan(path);
+        search_stats.solved = true;
+        search_stats.plan_length = actions.size();
+    }
+    else if(log_enabled(LOG_INFO))
+        cout<<"PATH NOT FOUND (width "<<novelty_max_width<<" exceeded)"<<endl;
+    return actions;
+}
+
+//=====================================================================================================================
+
+// Best-first width search, BFWS(w, #g): the open list is ordered by novelty first, then by the number of unsatisfied
+// goal atoms, then by generation order. Novelty is measured separately among the states with the same goal count, so
+// a state that satisfies one more goal atom starts with fresh tuples. Nothing is pruned and duplicates are detected,
+// which keeps the search complete; plans are not optimal.
+list<GroundedAction> bfws_planner(const GroundedTask &task)
+{
+    auto search_start = chrono::steady_clock::now();
+    const ActionTable action_table(task);
+    typedef tuple<int,int,int> BfwsKey;     //Novelty, unsatisfied goal atoms, node id
+    priority_queue<BfwsKey, vector<BfwsKey>, greater<BfwsKey>> open;
+    NoveltyTable novelty(task.atoms.size(),novelty_max_width,task.goal.size()+1);     //One partition per goal count
+
+    vector<TaskNode> nodes{TaskNode{task.initial_state,-1,-1,0}};
+    vector<int> goal_counts{unsatisfied_goal_count(task,task.initial_state)};
+    unordered_set<vector<int>,AtomStateHasher> generated{task.initial_state};
+    open.push(BfwsKey(novelty.evaluate(task.initial_state,nullptr,goal_counts[0]),goal_counts[0],0));
+    int goal_node = goal_counts[0]==0 ? 0 : -1;
+    vector<uint64_t> state_bits(action_table.words());
+    vector<int> applicable;
+    TraceRecorder trace;
+    if(trace_this_query())
+        trace.open(trace_file,task.actions);
+    while(goal_node==-1 && !open.empty() && !search_cancelled())
+    {
+        int node_id = get<2>(open.top());
+        open.pop();
+        trace_task_node(trace,nodes,node_id,goal_counts[node_id]);      //h is the number of unsatisfied goal atoms
+        search_stats.expansions++;
+        action_table.state_bits(nodes[node_id].state,state_bits.data());
+        action_table.applicable_actions(state_bits.data(),applicable);
+        for(int action:applicable)
+        {
+            search_stats.generations++;
+            auto successor = task.apply(nodes[node_id].state,action);
+            if(generated.count(successor))
+            {
+                search_stats.duplicates++;
+                continue;
+            }
+            generated.insert(successor);
+            int goal_count = unsatisfied_goal_count(task,successor);
+            // The parent's tuples were recorded in the partition of its own goal count only
+            const vector<int>* added_atoms = goal_count==goal_counts[node_id] ? &task.add_effects[action] : nullptr;
+            int successor_novelty = novelty.evaluate(successor,added_atoms,goal_count);
+            nodes.push_back(TaskNode{std::move(successor),node_id,action,nodes[node_id].gcost+1});
+            goal_counts.push_back(goal_count);
+            if(goal_count==0)
+            {
+                goal_node = nodes.size()-1;
+                break;
+            }
+            open.push(BfwsKey(successor_novelty,goal_count,nodes.size()-1));
+        }
+        search_stats.open_peak = max(search_stats.open_peak,open.size());
+    }
+    search_stats.search_seconds = seconds_since(search_start);
+    trace.close();
+
+    list<GroundedAction> actions;
+    if(goal_node!=-1)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        auto path = task_path_actions(nodes,goal_node);
+        reverse(path.begin(),path.end());
+        actions = task.to_plan(path);
+        search_stats.solved = true;
+        search_stats.plan_length = actions.size();
+    }
+    else if(log_enabled(LOG_INFO))
+        cout<<"PATH NOT FOUND"<<endl;
+    return actions;
+}
+
+//=====================================================================================================================
+
+// Successor of a beam layer. Candidates are ranked by goal count, then by parent and action, so the beam does not
+// depend on how the layer was split between threads.
+struct BeamCandidate
+{
+    int goal_count;
+    int parent;         //Index in the layer that was expanded
+    int action;
+    vector<int> state;
+
+    bool operator < (const BeamCandidate &other) const
+    {
+        return tie(this->goal_count,this->parent,this->action) < tie(other.goal_count,other.parent,other.action);
+    }
+};
+
+// Expands layer[first,last) and keeps at most width distinct candidates, the best ones, in best. Successors equal to a
+// state of the expanded layer are dropped. Returns the number of generated successors.
+long long expand_beam_slice(const GroundedTask &task, const ActionTable &action_table, const vector<vector<int>> &layer,
+                            const unordered_set<vector<int>,AtomStateHasher> &layer_states, size_t first, size_t last,
+                            size_t width, vector<BeamCandidate> &best)
+{
+    long long generations = 0;
+    priority_queue<BeamCandidate> worst_first;
+    unordered_set<vector<int>,AtomStateHasher> kept;
+    vector<uint64_t> state_bits(action_table.words());
+    vector<int> applicable;
+    for(size_t i=first;i<last;i++)
+    {
+        action_table.state_bits(layer[i],state_bits.data());
+        action_table.applicable_actions(state_bits.data(),applicable);
+        for(int action:applicable)
+        {
+            generations++;
+            BeamCandidate candidate{0,(int)i,action,task.apply(layer[i],action)};
+            candidate.goal_count = unsatisfied_goal_count(task,candidate.state);
+            // A candidate that does not beat the worst kept one cannot get in
+            if(worst_first.size()==width && !(candidate<worst_first.top()))
+                continue;
+            if(layer_states.count(candidate.state) || !kept.insert(candidate.state).second)
+                continue;
+            worst_first.push(std::move(candidate));
+            if(worst_first.size()>width)
+            {
+                kept.erase(worst_first.top().state);
+                worst_first.pop();
+            }
+        }
+    }
+    best.clear();
+    for(;!worst_first.empty();worst_first.pop())
+        best.push_back(worst_first.top());
+    return generations;
+}
+
+//=====================================================================================================================
+
+// Runs one beam search of the given width. Only the current layer is kept as states; earlier layers are kept as
+// (parent, action) links for the plan, so memory is bounded by width * beam_max_depth links plus two layers.
+bool beam_search(const GroundedTask &task, const ActionTable &action_table, size_t width, vector<int> &plan)
+{
+    vector<vector<int>> layer{task.initial_state};
+    vector<vector<pair<int,int>>> links;        //Per depth, the (parent, action) of every beam state
+    if(unsatisfied_goal_count(task,task.initial_state)==0)
+    {
+        plan.clear();
+        return true;
+    }
+    unsigned threads = beam_threads>0 ? beam_threads : max(1u,thread::hardware_concurrency());
+    for(int depth=0;depth<beam_max_depth && !layer.empty() && !search_cancelled();depth++)
+    {
+        unordered_set<vector<int>,AtomStateHasher> layer_states(layer.begin(),layer.end());
+        size_t slices = min<size_t>(threads,layer.size());
+        vector<vector<BeamCandidate>> slice_best(slices);
+        vector<long long> slice_generations(slices);
+        vector<thread> workers;
+        for(size_t s=0;s<slices;s++)
+        {
+            size_t first = layer.size()*s/slices, last = layer.size()*(s+1)/slices;
+            auto expand = [&,s,first,last]()
+            {
+                slice_generations[s] = expand_beam_slice(task,action_table,layer,layer_states,first,last,width,
+                                                         slice_best[s]);
+            };
+            if(s+1<slices)
+                workers.emplace_back(expand);
+            else
+                expand();
+        }
+        for(auto &worker:workers)
+            worker.join();
+
+        vector<BeamCandidate> candidates;
+        for(size_t s=0;s<slices;s++)
+        {
+            search_stats.generations += slice_generations[s];
+            for(auto &candidate:slice_best[s])
+                candidates.push_back(std::move(candidate));
+        }
+        search_stats.expansions += layer.size();
+        sort(candidates.begin(),candidates.end());
+        unordered_set<vector<int>,AtomStateHasher> next_states;
+        vector<vector<int>> next_layer;
+        links.emplace_back();
+        for(auto &candidate:candidates)
+        {
+            if(next_layer.size()==width)
+                break;
+            if(!next_states.insert(candidate.state).second)
+            {
+                search_stats.duplicates++;
+                continue;
+            }
+            links.back().push_back({candidate.parent,candidate.action});
+            next_layer.push_back(std::move(candidate.state));
+        }
+        layer = std::move(next_layer);
+        search_stats.open_peak = max(search_stats.open_peak,layer.size());
+
+        if(!layer.empty() && unsatisfied_goal_count(task,layer[0])==0)
+        {
+            plan.clear();
+            for(int index=0,d=links.size()-1;d>=0;d--)
+            {
+                plan.push_back(links[d][index].second);
+                index = links[d][index].first;
+            }
+            reverse(plan.begin(),plan.end());
+            return true;
+        }
+    }
+    return false;
+}
+
+//=====================================================================================================================
+
+// Beam search: a breadth-first search that keeps the beam_width states with the fewest unsatisfied goal atoms in each
+// layer, with duplicates removed inside the beam. The successors of a layer are generated on beam_threads threads.
+// Memory and time per layer are bounded by the width, at the price of optimality and completeness. When a beam dies
+// out or reaches beam_max_depth the search restarts up to beam_restarts times, doubling the width each time.
+list<GroundedAction> beam_planner(const GroundedTask &task)
+{
+    auto search_start = chrono::steady_clock::now();
+    const ActionTable action_table(task);
+    vector<int> plan;
+    bool found = false;
+    size_t width = max<size_t>(1,beam_width);
+    for(int attempt=0;attempt<=beam_restarts && !found && !search_cancelled();attempt++,width*=2)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"Beam search with width "<<width<<endl;
+        found = beam_search(task,action_table,width,plan);
+    }
+    search_stats.search_seconds = seconds_since(search_start);
+
+    list<GroundedAction> actions;
+    if(found)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        actions = task.to_plan(plan);
+        search_stats.solved = true;
+        search_stats.plan_length = actions.size();
+    }
+    else if(log_enabled(LOG_INFO))
+        cout<<"PATH NOT FOUND"<<endl;
+    return actions;
+}
+
+//=====================================================================================================================
+
+// Progress report of ResumableSearch::step().
+struct SearchProgress
+{
+    int status = STEP_RUNNING;
+    long long expansions = 0;
+    long long generations = 0;
+    size_t open_size = 0;
+    int best_goal_count = -1;       //Fewest unsatisfied goal atoms of any generated state
+    double best_gcost = 0;          //gcost of that state
+    double search_seconds = 0;      //Time spent inside step() so far
+};
+
+// Uniform cost search over the grounded task, the same search as A* with the planner's zero heuristic, run in slices
+// for callers that cannot block for a whole planner() call, such as an event loop. Each step() expands until its
+// expansion or time budget is spent and returns the progress. The open list and the gcosts stay in the object between
+// calls. cancel() may be called from any thread and ends the search at the next expansion. partial_plan() is the path
+// to the generated state with the fewest unsatisfied goal atoms, which is an optimal plan once the status is
+// STEP_SOLVED. Grounding happens in the constructor and is not sliced.
+class ResumableSearch
+{
+private:
+    const GroundedTask task;
+    const ActionTable action_table;
+    vector<TaskNode> nodes;
+    unordered_map<vector<int>,double,AtomStateHasher> best_gcost;
+    TaskOpenList open;
+    vector<uint64_t> state_bits;
+    vector<int> applicable;
+    int best_node = 0;
+    atomic<bool> cancelled{false};
+    SearchProgress progress;
+
+    void expand(int node_id)
+    {
+        this->progress.expansions++;
+        this->action_table.state_bits(this->nodes[node_id].state,this->state_bits.data());
+        this->action_table.applicable_actions(this->state_bits.data(),this->applicable);
+        for(int action:this->applicable)
+        {
+            this->progress.generations++;
+            auto successor = this->task.apply(this->nodes[node_id].state,action);
+            double new_g_cost = this->nodes[node_id].gcost+1;
+            auto best = this->best_gcost.find(successor);
+            if(best!=this->best_gcost.end() && best->second<=new_g_cost)
+                continue;
+            this->best_gcost[successor] = new_g_cost;
+            int goal_count = unsatisfied_goal_count(this->task,successor);
+            this->nodes.push_back(TaskNode{std::move(successor),node_id,action,new_g_cost});
+            this->open.push({new_g_cost,(int)this->nodes.size()-1});
+            if(goal_count<this->progress.best_goal_count)
+            {
+                this->best_node = this->nodes.size()-1;
+                this->progress.best_goal_count = goal_count;
+                this->progress.best_gcost = new_g_cost;
+            }
+        }
+    }
+
+public:
+    explicit ResumableSearch(Env* env): task(ground_task(env)),action_table(task)
+    {
+        this->nodes.push_back(TaskNode{this->task.initial_state,-1,-1,0});
+        this->best_gcost[this->task.initial_state] = 0;
+        this->open.push({0,0});
+        this->state_bits.resize(this->action_table.words());
+        this->progress.best_goal_count = unsatisfied_goal_count(this->task,this->task.initial_state);
+        this->progress.open_size = 1;
+    }
+
+    // Runs until max_expansions states were expanded or max_microseconds passed, whichever comes first (0 for no
+    // limit), or until the search ends. At least one state is expanded per call.
+    SearchProgress step(long long max_expansions, double max_microseconds)
+    {
+        auto step_start = chrono::steady_clock::now();
+        long long step_expansions = 0;
+        while(this->progress.status==STEP_RUNNING)
+        {
+            if(this->cancelled.load(memory_order_relaxed))
+                this->progress.status = STEP_CANCELLED;
+            else if(this->open.empty())
+                this->progress.status = STEP_FAILED;
+            else if(step_expansions>0 && ((max_expansions>0 && step_expansions>=max_expansions)
+                    || (max_microseconds>0 && seconds_since(step_start)*1e6>=max_microseconds)))
+                break;
+            else
+            {
+                int node_id = this->open.top().second;
+                this->open.pop();
+                const auto &node = this->nodes[node_id];
+                if(node.gcost>this->best_gcost[node.state])
+                    continue;
+                if(this->task.satisfies(node.state,this->task.goal))
+                {
+                    this->best_node = node_id;
+                    this->progress.best_goal_count = 0;
+                    this->progress.best_gcost = node.gcost;
+                    this->progress.status = STEP_SOLVED;
+                    break;
+                }
+                this->expand(node_id);
+                step_expansions++;
+            }
+        }
+        this->progress.open_size = this->open.size();
+        this->progress.search_seconds += seconds_since(step_start);
+        return this->progress;
+    }
+
+    void cancel()
+    {
+        this->cancelled = true;
+    }
+
+    const SearchProgress& get_progress() const
+    {
+        return this->progress;
+    }
+
+    list<GroundedAction> partial_plan() const
+    {
+        auto path = task_path_actions(this->nodes,this->best_node);
+        reverse(path.begin(),path.end());
+        return this->task.to_plan(path);
+    }
+};
+
+//=====================================================================================================================
+
+// Incremental replanning for a fixed goal and a drifting initial state, in the spirit of D* Lite. The search regresses
+// from the goal, so the gcost of a subgoal is its distance to the goal and does not depend on the initial state. The
+// graph is kept between queries, and a change of the initial state only moves the target: the closed subgoals that
+// hold in it. These are tracked through per-atom lists of the generated subgoals, so applying a change touches only the
+// subgoals that mention a changed atom, and the search resumes only if no known subgoal beats the open list.
+//
+// The initial state affects the graph in two places. A subgoal that needs a static atom which is false initially is
+// dead and is parked when generated instead of being put on open. When a change makes such an atom true the parked
+// subgoals go back on open and the lower gcosts they lead to are propagated by reopening closed subgoals, which is
+// LPA*'s repair for edges that got cheaper. A static atom turning false needs no repair because every regression of a
+// dead subgoal is dead too. With the zero heuristic of the planner the keys are plain gcosts, so moving the target does
+// not invalidate open. Subgoals with a pair of atoms that are h^2 mutex from the initial state are not generated at
+// all. h^2 is recomputed only when a change adds an atom that is mutex with the new initial state, and only when that
+// finds a pair reachable that was mutex before are the closed subgoals expanded again. Subgoals that break a ground mutex invariant are unreachable from any initial state that
+// satisfies the invariants and are dropped for good; a change to an initial state that breaks one rebuilds the graph.
+class IncrementalRegression
+{
+private:
+    enum Status {OPEN, CLOSED, PARKED};
+
+    GroundedTask task;
+    string task_key;
+    unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> initial_conditions;
+    vector<bool> is_static;
+    vector<bool> initially_true;
+    vector<TaskNode> nodes;
+    vector<Status> status;
+    vector<int> missing;                    //node -> atoms of its subgoal that are false in the initial state
+    vector<vector<int>> subgoals_with;      //atom -> nodes whose subgoal contains it
+    unordered_map<vector<int>,int,AtomStateHasher> node_ids;
+    TaskOpenList open;
+    set<pair<double,int>> satisfied;        //Closed nodes whose subgoal holds in the initial state
+    vector<vector<int>> mutex_groups;       //Ground invariants: at most one atom of a group is true in any state
+    vector<vector<int>> groups_with;        //atom -> mutex groups that contain it
+    vector<int> group_stamp;
+    int stamp = 0;
+    vector<char> applicable;                //Actions that h^2 finds applicable from the initial state
+
+    // A subgoal with two atoms of one mutex group holds in no reachable state, whatever the initial state, as long as
+    // the initial state satisfies the invariants (checked by mutexes_hold)
+    bool is_mutex(const vector<int> &subgoal)
+    {
+        this->stamp++;
+        for(int atom:subgoal)
+        {
+            for(int group:this->groups_with[atom])
+            {
+                if(this->group_stamp[group]==this->stamp)
+                    return true;
+                this->group_stamp[group] = this->stamp;
+            }
+        }
+        return false;
+    }
+
+    bool is_dead(int node) const
+    {
+        for(int atom:this->nodes[node].state)
+            if(this->is_static[atom] && !this->initially_true[atom])
+                return true;
+        return false;
+    }
+
+    // h^2 of the current initial state. The actions it finds unreachable are skipped by the search but kept in the
+    // task, as a change may make them reachable. Returns whether some pair that was mutex before is reachable now.
+    bool compute_mutexes()
+    {
+        this->task.initial_state.clear();
+        for(int atom=0;atom<(int)this->task.atoms.size();atom++)
+            if(this->initially_true[atom])
+                this->task.initial_state.push_back(atom);
+        auto previous = std::move(this->task.h2_reachable);
+        this->task.h2_reachable.clear();
+        if(use_h2_mutexes)
+            this->task.h2_reachable = h2_reachable_pairs(this->task,this->applicable);
+        if(this->task.h2_reachable.empty())
+        {
+            this->applicable.assign(this->task.actions.size(),1);
+            return !previous.empty();
+        }
+        if(previous.empty())
+            return false;
+        for(size_t p=0;p<previous.size();p++)
+            for(size_t q=0;q<previous.size();q++)
+                if(!previous[p][q] && this->task.h2_reachable[p][q])
+                    return true;
+        return false;
+    }
+
+    // h^2 is a least fixpoint that grows with the initial state. When every added atom is already reachable together
+    // with each atom of the new initial state, the old fixpoint contains the new starting pairs and is unchanged. A
+    // removed atom can only add mutexes, and the old table still over-approximates, so removals never recompute; the
+    // mutexes they would add are missed until an addition triggers the next recomputation.
+    bool mutexes_may_weaken(const vector<int> &added_atoms) const
+    {
+        if(this->task.h2_reachable.empty())
+            return false;
+        for(int atom:added_atoms)
+            for(int other=0;other<(int)this->task.atoms.size();other++)
+                if(this->initially_true[other] && !this->task.h2_reachable[atom][other])
+                    return true;
+        return false;
+    }
+
+    bool is_satisfied(int node) const
+    {
+        return this->status[node]==CLOSED && this->missing[node]==0;
+    }
+
+    void set_status(int node, Status new_status)
+    {
+        if(this->is_satisfied(node))
+            this->satisfied.erase({this->nodes[node].gcost,node});
+        this->status[node] = new_status;
+        if(this->is_satisfied(node))
+            this->satisfied.insert({this->nodes[node].gcost,node});
+    }
+
+    void set_initially_true(int atom, bool value)
+    {
+        if(this->initially_true[atom]==value)
+            return;
+        this->initially_true[atom] = value;
+        for(int node:this->subgoals_with[atom])
+        {
+            bool was_satisfied = this->is_satisfied(node);
+            this->missing[node] += value ? -1 : 1;
+            if(was_satisfied && !this->is_satisfied(node))
+                this->satisfied.erase({this->nodes[node].gcost,node});
+            else if(!was_satisfied && this->is_satisfied(node))
+                this->satisfied.insert({this->nodes[node].gcost,node});
+            if(value && this->status[node]==PARKED && !this->is_dead(node))
+            {
+                this->set_status(node,OPEN);
+                this->open.push({this->nodes[node].gcost,node});
+            }
+        }
+    }
+
+    void reach(const vector<int> &subgoal, int parent, int action, double gcost)
+    {
+        search_stats.generations++;
+        if(this->is_mutex(subgoal) || this->task.has_mutex(subgoal))
+        {
+            search_stats.pruned_actions++;
+            return;
+        }
+        auto found = this->node_ids.find(subgoal);
+        if(found==this->node_ids.end())
+        {
+            int node = this->nodes.size();
+            this->nodes.push_back(TaskNode{subgoal,parent,action,gcost});
+            this->status.push_back(OPEN);
+            int false_atoms = 0;
+            for(int atom:subgoal)
+            {
+                this->subgoals_with[atom].push_back(node);
+                false_atoms += !this->initially_true[atom];
+            }
+            this->missing.push_back(false_atoms);
+            this->node_ids.insert({subgoal,node});
+            if(this->is_dead(node))
+                this->status[node] = PARKED;     //Goes on open when the static atom it needs becomes true
+            else
+                this->open.push({gcost,node});
+            return;
+        }
+
+        int node = found->second;
+        if(this->nodes[node].gcost<=gcost)
+        {
+            search_stats.duplicates++;
+            return;
+        }
+        if(this->status[node]==CLOSED)
+            search_stats.reopenings++;
+        this->set_status(node,OPEN);
+        this->nodes[node].parent = parent;
+        this->nodes[node].action = action;
+        this->nodes[node].gcost = gcost;
+        this->open.push({gcost,node});
+    }
+
+    // Expands subgoals in gcost order until none on open can beat the cheapest satisfied one. Returns that one, or -1.
+    int search()
+    {
+        vector<int> regressed;
+        while(!this->open.empty())
+        {
+            double gcost = this->open.top().first;
+            int node = this->open.top().second;
+            if(this->status[node]!=OPEN || gcost>this->nodes[node].gcost)
+            {
+                this->open.pop();   //Stale entry
+                continue;
+            }
+            if(!this->satisfied.empty() && this->satisfied.begin()->first<=gcost)
+                break;
+            this->open.pop();
+            if(this->is_dead(node))
+            {
+                this->set_status(node,PARKED);
+                continue;
+            }
+            this->set_status(node,CLOSED);
+
+            search_stats.expansions++;
+            for(int action=0;action<(int)this->task.actions.size();action++)
+                if(this->applicable[action] && regress(this->task,this->nodes[node].state,action,regressed))
+                    this->reach(regressed,node,action,gcost+1);
+            search_stats.open_peak = max(search_stats.open_peak,this->open.size());
+        }
+        return this->satisfied.empty() ? -1 : this->satisfied.begin()->second;
+    }
+
+    list<GroundedAction> extract_plan(int node)
+    {
+        if(node==-1)
+        {
+            if(log_enabled(LOG_INFO))
+                cout<<"PATH NOT FOUND"<<endl;
+            return list<GroundedAction>();
+        }
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        auto plan = this->task.to_plan(task_path_actions(this->nodes,node));     //Already in execution order
+        search_stats.solved = true;
+        search_stats.plan_length = plan.size();
+        return plan;
+    }
+
+public:
+    IncrementalRegression(Env* env, const string &key)
+        : task(ground_task(env,false)), task_key(key), initial_conditions(env->get_initial_conditions())
+    {
+        this->is_static = find_static_atoms(this->task);
+        this->initially_true.assign(this->task.atoms.size(),false);
+        for(int atom:this->task.initial_state)
+            this->initially_true[atom] = true;
+        this->subgoals_with.resize(this->task.atoms.size());
+        this->groups_with.resize(this->task.atoms.size());
+        for(const auto &invariant:this->task.invariants)
+        {
+            for(auto &group:FiniteDomainTask::ground_invariant(this->task,invariant,this->is_static))
+            {
+                for(int atom:group)
+                    this->groups_with[atom].push_back(this->mutex_groups.size());
+                this->mutex_groups.push_back(std::move(group));
+            }
+        }
+        this->group_stamp.assign(this->mutex_groups.size(),0);
+        this->compute_mutexes();
+        this->reach(this->task.goal,-1,-1,0);
+    }
+
+    // False when the conditions break a mutex group the graph was pruned with; the graph has to be rebuilt then
+    bool mutexes_hold(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &conditions)
+    {
+        vector<int> atoms;
+        for(const auto &condition:conditions)
+        {
+            auto atom = this->task.atom_ids.find(condition);
+            if(atom!=this->task.atom_ids.end())
+                atoms.push_back(atom->second);
+        }
+        return !this->is_mutex(atoms);
+    }
+
+    const string& key() const
+    {
+        return this->task_key;
+    }
+
+    const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator>& get_initial_conditions() const
+    {
+        return this->initial_conditions;
+    }
+
+    list<GroundedAction> plan()
+    {
+        auto search_start = chrono::steady_clock::now();
+        int node = this->search();
+        search_stats.search_seconds = seconds_since(search_start);
+        return this->extract_plan(node);
+    }
+
+    // Applies a change of the initial state and returns an optimal plan from the new one. Conditions that no action
+    // or goal mentions cannot appear in a subgoal and are only recorded.
+    list<GroundedAction> replan(const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &added,
+                                const unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> &removed)
+    {
+        auto search_start = chrono::steady_clock::now();
+        for(const auto &condition:removed)
+        {
+            this->initial_conditions.erase(condition);
+            auto atom = this->task.atom_ids.find(condition);
+            if(atom!=this->task.atom_ids.end())
+                this->set_initially_true(atom->second,false);
+        }
+        vector<int> added_atoms;
+        for(const auto &condition:added)
+        {
+            this->initial_conditions.insert(condition);
+            auto atom = this->task.atom_ids.find(condition);
+            if(atom!=this->task.atom_ids.end())
+            {
+                this->set_initially_true(atom->second,true);
+                added_atoms.push_back(atom->second);
+            }
+        }
+        // The closed subgoals were expanded without the regressions that h^2 rejected. If it rejects less now they are
+        // expanded again; in domains where every state can reach every other the mutexes stay the same.
+        if(this->mutexes_may_weaken(added_atoms) && this->compute_mutexes())
+        {
+            this->reach(this->task.goal,-1,-1,0);   //The goal itself may have been mutex
+            for(int node=0;node<(int)this->nodes.size();node++)
+            {
+                if(this->status[node]==CLOSED)
+                {
+                    this->set_status(node,OPEN);
+                    this->open.push({this->nodes[node].gcost,node});
+                }
+            }
+        }
+        int node = this->search();
+        search_stats.search_seconds = seconds_since(search_start);
+        return this->extract_plan(node);
+    }
+};
+
+unique_ptr<IncrementalRegression> incremental_search;     //Graph of the previous query, reused by incremental_planner
+
+//=====================================================================================================================
+
+// Everything of the task except its initial state: the graph of incremental_planner is only valid while this is equal.
+string incremental_task_key(Env* env)
+{
+    vector<string> parts;
+    for(const auto &symbol:env->get_symbols())
+        parts.push_back("S:" + symbol);
+    for(const auto &action:env->get_all_actions())
+    {
+        ostringstream action_text;
+        action_text<<action;
+        parts.push_back("A:" + action_text.str());
+    }
+    sort(parts.begin(),parts.end());
+    string key = "G:" + canonical_conditions_string(env->get_goal_conditions());
+    for(const auto &part:parts)
+        key += part;
+    return key;
+}
+
+//=====================================================================================================================
+
+list<GroundedAction> incremental_planner(Env* env)
+{
+    string key = incremental_task_key(env);
+    if(!incremental_search || incremental_search->key()!=key
+       || !incremental_search->mutexes_hold(env->get_initial_conditions()))
+    {
+        incremental_search.reset(new IncrementalRegression(env,key));
+        return incremental_search->plan();
+    }
+
+    const auto &initial_conditions = env->get_initial_conditions();
+    const auto &previous = incremental_search->get_initial_conditions();
+    unordered_set<GroundedCondition, GroundedConditionHasher, GroundedConditionComparator> added, removed;
+    for(const auto &condition:initial_conditions)
+        if(!previous.count(condition))
+            added.insert(condition);
+    for(const auto &condition:previous)
+        if(!initial_conditions.count(condition))
+            removed.insert(condition);
+    if(log_enabled(LOG_INFO))
+        cout<<"Replanning after "<<added.size()<<" added and "<<removed.size()<<" removed initial conditions"<<endl;
+    return incremental_search->replan(added,removed);
+}
+
+//=====================================================================================================================
+
+// FNV-1a, used where a hash has to agree between processes
+uint64_t fnv1a_hash(const char* data, size_t length, uint64_t seed = 14695981039346656037ULL)
+{
+    for(size_t i=0;i<length;i++)
+        seed = (seed ^ (unsigned char)data[i]) * 1099511628211ULL;
+    return seed;
+}
+
+//=====================================================================================================================
+
+// Full mesh of stream sockets between the processes of a distributed search, one per peer. A message is a type byte,
+// a 32 bit payload length and the payload. send() only queues; pump() polls every socket at once, writes what the
+// peers can take and reads what they sent, so two processes sending each other large batches cannot deadlock on full
+// socket buffers. Messages from one peer arrive in the order they were sent. A peer closing its end is only an error
+// when a message from it is still awaited, since peers exit at their own pace once the search is over.
+class SocketMesh
+{
+private:
+    struct Peer
+    {
+        int fd = -1;
+        bool closed = false;    //The peer closed its end; what is left in the inbox can still be read
+        string outbox;
+        size_t outbox_sent = 0;
+        string inbox;
+        size_t inbox_read = 0;
+    };
+
+    int rank;
+    vector<Peer> peers;
+    size_t next_peer = 0;       //Round robin start of receive_any
+
+    static void set_nonblocking(int fd)
+    {
+        fcntl(fd,F_SETFL,fcntl(fd,F_GETFL,0) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(fd,SOL_SOCKET,SO_NOSIGPIPE,&on,sizeof(on));
+#endif
+    }
+
+    static void write_fully(int fd, const void* data, size_t length)
+    {
+        const char* bytes = (const char*)data;
+        while(length>0)
+        {
+            ssize_t written = write(fd,bytes,length);
+            if(written<0 && errno==EINTR)
+                continue;
+            if(written<=0)
+                throw runtime_error(string("Distributed search handshake failed: ") + strerror(errno));
+            bytes += written;
+            length -= written;
+        }
+    }
+
+    static void read_fully(int fd, void* data, size_t length)
+    {
+        char* bytes = (char*)data;
+        while(length>0)
+        {
+            ssize_t got = read(fd,bytes,length);
+            if(got<0 && errno==EINTR)
+                continue;
+            if(got<=0)
+                throw runtime_error("Distributed search handshake failed: connection closed");
+            bytes += got;
+            length -= got;
+        }
+    }
+
+    // Takes one complete message of the peer out of its inbox
+    bool pop_message(int peer, char &type, string &payload)
+    {
+        auto &p = this->peers[peer];
+        const size_t header = 1 + sizeof(uint32_t);
+        if(p.inbox.size()-p.inbox_read<header)
+            return false;
+        uint32_t length;
+        memcpy(&length,&p.inbox[p.inbox_read+1],sizeof(length));
+        if(p.inbox.size()-p.inbox_read<header+length)
+            return false;
+        type = p.inbox[p.inbox_read];
+        payload.assign(p.inbox,p.inbox_read+header,length);
+        p.inbox_read += header+length;
+        if(p.inbox_read==p.inbox.size() || p.inbox_read>(1<<20))
+        {
+            p.inbox.erase(0,p.inbox_read);
+            p.inbox_read = 0;
+        }
+        return true;
+    }
+
+public:
+    SocketMesh(int rank, int size): rank(rank),peers(size) {}
+
+    ~SocketMesh()
+    {
+        for(auto &peer:this->peers)
+            if(peer.fd!=-1)
+                close(peer.fd);
+    }
+
+    int get_rank() const
+    {
+        return this->rank;
+    }
+
+    int size() const
+    {
+        return this->peers.size();
+    }
+
+    void attach(int peer, int fd)
+    {
+        set_nonblocking(fd);
+        this->peers[peer].fd = fd;
+    }
+
+    // TCP mesh over host:port addresses, one per rank: every process listens on its own port, connects to the lower
+    // ranks and accepts the higher ones. The first bytes on a connection are the rank and the task fingerprint of the
+    // connecting process, so that processes that grounded different tasks refuse to work together.
+    void connect_tcp(const vector<string> &addresses, uint64_t fingerprint, double timeout_seconds)
+    {
+        auto resolve = [](const string &address, addrinfo* &result)
+        {
+            size_t colon = address.rfind(':');
+            if(colon==string::npos)
+                throw runtime_error("Distributed peer " + address + " is not host:port");
+            addrinfo hints;
+            memset(&hints,0,sizeof(hints));
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            if(getaddrinfo(address.substr(0,colon).c_str(),address.substr(colon+1).c_str(),&hints,&result)!=0)
+                throw runtime_error("Unable to resolve distributed peer " + address);
+        };
+
+        int listener = -1;
+        if(this->rank+1<this->size())
+        {
+            addrinfo* own = nullptr;
+            resolve(addresses[this->rank],own);
+            listener = socket(AF_INET,SOCK_STREAM,0);
+            int on = 1;
+            setsockopt(listener,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+            sockaddr_in any;
+            memcpy(&any,own->ai_addr,sizeof(any));
+            any.sin_addr.s_addr = htonl(INADDR_ANY);
+            freeaddrinfo(own);
+            if(::bind(listener,(sockaddr*)&any,sizeof(any))!=0 || listen(listener,this->size())!=0)
+                throw runtime_error("Unable to listen on " + addresses[this->rank] + ": " + strerror(errno));
+        }
+
+        auto deadline = chrono::steady_clock::now() + chrono::duration<double>(timeout_seconds);
+        for(int peer=0;peer<this->rank;peer++)
+        {
+            addrinfo* remote = nullptr;
+            resolve(addresses[peer],remote);
+            int fd = -1;
+            while(true)
+            {
+                fd = socket(AF_INET,SOCK_STREAM,0);
+                if(connect(fd,remote->ai_addr,remote->ai_addrlen)==0)
+                    break;
+                close(fd);
+                if(chrono::steady_clock::now()>deadline)
+                {
+                    freeaddrinfo(remote);
+                    throw runtime_error("Unable to connect to distributed peer " + addresses[peer]);
+                }
+                this_thread::sleep_for(chrono::milliseconds(100));
+            }
+            freeaddrinfo(remote);
+            int on = 1;
+            setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+            int32_t own_rank = this->rank;
+            write_fully(fd,&own_rank,sizeof(own_rank));
+            write_fully(fd,&fingerprint,sizeof(fingerprint));
+            this->attach(peer,fd);
+        }
+        for(int accepted=this->rank+1;accepted<this->size();accepted++)
+        {
+            int fd = accept(listener,nullptr,nullptr);
+            if(fd<0)
+                throw runtime_error(string("Distributed search accept failed: ") + strerror(errno));
+            int32_t peer_rank;
+            uint64_t peer_fingerprint;
+            read_fully(fd,&peer_rank,sizeof(peer_rank));
+            read_fully(fd,&peer_fingerprint,sizeof(peer_fingerprint));
+            if(peer_rank<=this->rank || peer_rank>=this->size() || this->peers[peer_rank].fd!=-1)
+                throw runtime_error("Unexpected distributed peer rank " + to_string(peer_rank));
+            if(peer_fingerprint!=fingerprint)
+                throw runtime_error("Distributed peer " + to_string(peer_rank) + " grounded a different task");
+            int on = 1;
+            setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+            this->attach(peer_rank,fd);
+        }
+        if(listener!=-1)
+            close(listener);
+    }
+
+    void send(int peer, char type, const string &payload)
+    {
+        auto &p = this->peers[peer];
+        uint32_t length = payload.size();
+        p.outbox.push_back(type);
+        p.outbox.append((const char*)&length,sizeof(length));
+        p.outbox.append(payload);
+    }
+
+    size_t pending_bytes(int peer) const
+    {
+        return this->peers[peer].outbox.size()-this->peers[peer].outbox_sent;
+    }
+
+    // One round of non-blocking I/O on every socket, waiting up to timeout_ms for any of them to become ready
+    void pump(int timeout_ms)
+    {
+        vector<pollfd> fds;
+        vector<int> ranks;
+        for(int peer=0;peer<this->size();peer++)
+        {
+            if(peer==this->rank || this->peers[peer].closed)
+                continue;
+            short events = POLLIN;
+            if(this->pending_bytes(peer))
+                events |= POLLOUT;
+            fds.push_back(pollfd{this->peers[peer].fd,events,0});
+            ranks.push_back(peer);
+        }
+        if(fds.empty())
+            return;
+        if(poll(fds.data(),fds.size(),timeout_ms)<0)
+        {
+            if(errno==EINTR)
+                return;
+            throw runtime_error(string("Distributed search poll failed: ") + strerror(errno));
+        }
+        char buffer[1 << 16];
+        for(size_t i=0;i<fds.size();i++)
+        {
+            auto &p = this->peers[ranks[i]];
+            if(fds[i].revents & POLLOUT)
+            {
+#ifdef MSG_NOSIGNAL
+                ssize_t written = ::send(p.fd,p.outbox.data()+p.outbox_sent,this->pending_bytes(ranks[i]),MSG_NOSIGNAL);
+#else
+                ssize_t written = ::send(p.fd,p.outbox.data()+p.outbox_sent,this->pending_bytes(ranks[i]),0);
+#endif
+                if(written<0 && errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR)
+                    throw runtime_error("Distributed peer " + to_string(ranks[i]) + " disconnected");
+                if(written>0)
+                    p.outbox_sent += written;
+                if(p.outbox_sent==p.outbox.size())
+                {
+                    p.outbox.clear();
+                    p.outbox_sent = 0;
+                }
+            }
+            if(fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                ssize_t got = read(p.fd,buffer,sizeof(buffer));
+                if(got==0 || (got<0 && errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR))
+                    p.closed = true;
+                if(got>0)
+                    p.inbox.append(buffer,got);
+            }
+        }
+    }
+
+    // Pumps until the peer has taken every queued byte. Used to bound the memory of the outboxes.
+    void drain(int peer)
+    {
+        while(this->pending_bytes(peer))
+        {
+            if(this->peers[peer].closed)
+                throw runtime_error("Distributed peer " + to_string(peer) + " disconnected");
+            this->pump(100);
+        }
+    }
+
+    void flush()
+    {
+        for(int peer=0;peer<this->size();peer++)
+            if(peer!=this->rank)
+                this->drain(peer);
+    }
+
+    // Blocks until a message arrives from any peer, taking the peers in turn so that none of them starves
+    int receive_any(char &type, string &payload)
+    {
+        while(true)
+        {
+            for(int i=0;i<this->size();i++)
+            {
+                int peer = (this->next_peer+i) % this->size();
+                if(peer!=this->rank && this->pop_message(peer,type,payload))
+                {
+                    this->next_peer = peer+1;
+                    return peer;
+                }
+            }
+            for(int peer=0;peer<this->size();peer++)
+                if(peer!=this->rank && this->peers[peer].closed)
+                    throw runtime_error("Distributed peer " + to_string(peer) + " disconnected");
+            this->pump(100);
+        }
+    }
+
+    void receive_from(int peer, char &type, string &payload)
+    {
+        while(!this->pop_message(peer,type,payload))
+        {
+            if(this->peers[peer].closed)
+                throw runtime_error("Distributed peer " + to_string(peer) + " disconnected");
+            this->pump(100);
+        }
+    }
+};
+
+//=====================================================================================================================
+
+// Appends and reads fixed-size values of message payloads
+template <typename T>
+void put_value(string &payload, T value)
+{
+    payload.append((const char*)&value,sizeof(value));
+}
+
+template <typename T>
+T get_value(const string &payload, size_t &offset)
+{
+    T value;
+    memcpy(&value,payload.data()+offset,sizeof(value));
+    offset += sizeof(value);
+    return value;
+}
+
+//=====================================================================================================================
+
+// Hash-distributed breadth-first search. Every process grounds the same task and owns the states whose packed
+// finite-domain encoding hashes to its rank; only the owner keeps a state in its closed list, together with the rank,
+// id and action of the parent it was first reached from. A layer is expanded by all processes at once, successors of
+// other owners are sent in batches of distributed_batch_bytes, and a goal is detected when its owner first receives it.
+//
+// Termination: after its successors a process sends an end-of-layer message to every peer, and because each socket
+// delivers in order, receiving the end-of-layer of every peer means no successor of the layer is still in flight.
+// Each process then reports its next layer size and any goal to rank 0, which decides for everyone whether to stop
+// (goal found, or every next layer empty) or to expand the next layer. Layers keep the plans optimal for unit costs.
+// Rank 0 reconstructs the plan by asking the owners of the states on the path for their parent links.
+class DistributedSearch
+{
+private:
+    enum MessageType : char {SUCCESSORS=1, END_OF_LAYER, REPORT, DECISION, PARENT_QUERY, PARENT_REPLY, SHUTDOWN};
+
+    struct Record
+    {
+        int32_t parent_rank;
+        int32_t parent_id;
+        int32_t action;
+    };
+
+    const GroundedTask &task;
+    const FiniteDomainTask fdr;
+    const ActionTable actions;
+    SocketMesh &mesh;
+    size_t state_bytes;
+    unordered_map<string,int> closed;       //Packed state -> id
+    vector<Record> records;
+    vector<const string*> layer;            //Keys of closed, stable under rehashing
+    vector<const string*> next_layer;
+    int goal_id = -1;
+    long long expansions = 0;
+    long long generations = 0;
+    long long duplicates = 0;
+    vector<string> stashed_reports;         //Reports that rank 0 received before it finished its own layer
+
+    int owner(const string &packed) const
+    {
+        return fnv1a_hash(packed.data(),packed.size()) % this->mesh.size();
+    }
+
+    void insert(const string &packed, const Record &record, bool is_goal)
+    {
+        if(this->closed.count(packed))
+        {
+            this->duplicates++;
+            return;
+        }
+        int id = this->records.size();
+        auto inserted = this->closed.insert({packed,id});
+        this->records.push_back(record);
+        this->next_layer.push_back(&inserted.first->first);
+        if(is_goal && this->goal_id==-1)
+            this->goal_id = id;
+    }
+
+    void receive_successors(const string &payload, int sender)
+    {
+        const size_t record_bytes = this->state_bytes + 2*sizeof(int32_t) + 1;
+        for(size_t offset=0;offset+record_bytes<=payload.size();)
+        {
+            string packed = payload.substr(offset,this->state_bytes);
+            offset += this->state_bytes;
+            int32_t parent_id = get_value<int32_t>(payload,offset);
+            int32_t action = get_value<int32_t>(payload,offset);
+            bool is_goal = get_value<char>(payload,offset);
+            this->insert(packed,Record{sender,parent_id,action},is_goal);
+        }
+    }
+
+    void expand_layer()
+    {
+        const int size = this->mesh.size();
+        const int rank = this->mesh.get_rank();
+        vector<string> batches(size);
+        vector<uint64_t> state_bits(this->actions.words());
+        vector<int> applicable;
+        string packed(this->state_bytes,'\0');
+        for(const string* key:this->layer)
+        {
+            int id = this->closed.at(*key);
+            auto state = this->fdr.unpack((const unsigned char*)key->data());
+            this->expansions++;
+            this->actions.state_bits(state,state_bits.data());
+            this->actions.applicable_actions(state_bits.data(),applicable);
+            for(int action:applicable)
+            {
+                this->generations++;
+                auto successor = this->task.apply(state,action);
+                bool is_goal = this->task.satisfies(successor,this->task.goal);
+                this->fdr.pack(successor,(unsigned char*)&packed[0]);
+                int successor_owner = this->owner(packed);
+                if(successor_owner==rank)
+                {
+                    this->insert(packed,Record{rank,id,action},is_goal);
+                    continue;
+                }
+                auto &batch = batches[successor_owner];
+                batch.append(packed);
+                put_value<int32_t>(batch,id);
+                put_value<int32_t>(batch,action);
+                put_value<char>(batch,is_goal);
+                if(batch.size()>=distributed_batch_bytes)
+                {
+                    // Wait for the peer to take the previous batch before queueing more, so outboxes stay bounded
+                    this->mesh.drain(successor_owner);
+                    this->mesh.send(successor_owner,SUCCESSORS,batch);
+                    batch.clear();
+                    this->mesh.pump(0);
+                }
+            }
+            // Take in what the peers sent meanwhile, so their outboxes do not fill up waiting for this process
+            this->mesh.pump(0);
+        }
+        for(int peer=0;peer<size;peer++)
+        {
+            if(peer==rank)
+                continue;
+            if(!batches[peer].empty())
+                this->mesh.send(peer,SUCCESSORS,batches[peer]);
+            this->mesh.send(peer,END_OF_LAYER,"");
+        }
+
+        int ends = 0;
+        char type;
+        string payload;
+        while(ends<size-1)
+        {
+            int sender = this->mesh.receive_any(type,payload);
+            if(type==SUCCESSORS)
+                this->receive_successors(payload,sender);
+            else if(type==END_OF_LAYER)
+                ends++;
+            else if(type==REPORT && rank==0)
+                this->stashed_reports.push_back(payload);
+            else
+                throw runtime_error("Unexpected distributed search message " + to_string((int)type));
+        }
+        this->mesh.flush();
+    }
+
+    string report() const
+    {
+        string payload;
+        put_value<int64_t>(payload,this->next_layer.size());
+        put_value<int32_t>(payload,this->goal_id);
+        put_value<int32_t>(payload,this->mesh.get_rank());
+        put_value<int64_t>(payload,this->expansions);
+        put_value<int64_t>(payload,this->generations);
+        put_value<int64_t>(payload,this->duplicates);
+        return payload;
+    }
+
+    // Rank 0: gathers the reports of a layer and decides whether to go on. Returns true to continue.
+    bool coordinate(int &goal_rank, int &goal_node)
+    {
+        vector<string> reports{this->report()};
+        reports.insert(reports.end(),this->stashed_reports.begin(),this->stashed_reports.end());
+        this->stashed_reports.clear();
+        char type;
+        string payload;
+        while((int)reports.size()<this->mesh.size())
+        {
+            this->mesh.receive_any(type,payload);
+            if(type!=REPORT)
+                throw runtime_error("Unexpected distributed search message " + to_string((int)type));
+            reports.push_back(payload);
+        }
+
+        long long next_layer_size = 0;
+        goal_rank = -1;
+        goal_node = -1;
+        search_stats.expansions = search_stats.generations = search_stats.duplicates = 0;
+        for(const auto &r:reports)
+        {
+            size_t offset = 0;
+            next_layer_size += get_value<int64_t>(r,offset);
+            int32_t goal = get_value<int32_t>(r,offset);
+            int32_t rank = get_value<int32_t>(r,offset);
+            search_stats.expansions += get_value<int64_t>(r,offset);
+            search_stats.generations += get_value<int64_t>(r,offset);
+            search_stats.duplicates += get_value<int64_t>(r,offset);
+            if(goal!=-1 && (goal_rank==-1 || rank<goal_rank))
+            {
+                goal_rank = rank;
+                goal_node = goal;
+            }
+        }
+        search_stats.open_peak = max<size_t>(search_stats.open_peak,next_layer_size);
+        bool go_on = goal_rank==-1 && next_layer_size>0;
+
+        string decision;
+        put_value<char>(decision,go_on);
+        for(int peer=1;peer<this->mesh.size();peer++)
+            this->mesh.send(peer,DECISION,decision);
+        this->mesh.flush();
+        return go_on;
+    }
+
+    // Ranks other than 0: answers parent queries until rank 0 is done with the plan
+    void serve_parent_queries()
+    {
+        char type;
+        string payload;
+        while(true)
+        {
+            this->mesh.receive_from(0,type,payload);
+            if(type==SHUTDOWN)
+                return;
+            if(type!=PARENT_QUERY)
+                throw runtime_error("Unexpected distributed search message " + to_string((int)type));
+            size_t offset = 0;
+            const auto &record = this->records.at(get_value<int32_t>(payload,offset));
+            string reply;
+            put_value<int32_t>(reply,record.parent_rank);
+            put_value<int32_t>(reply,record.parent_id);
+            put_value<int32_t>(reply,record.action);
+            this->mesh.send(0,PARENT_REPLY,reply);
+            this->mesh.flush();
+        }
+    }
+
+    vector<int> reconstruct(int goal_rank, int goal_node)
+    {
+        vector<int> plan;
+        Record record;
+        for(int rank=goal_rank,node=goal_node;;rank=record.parent_rank,node=record.parent_id)
+        {
+            if(rank==0)
+                record = this->records.at(node);
+            else
+            {
+                string query;
+                put_value<int32_t>(query,node);
+                this->mesh.send(rank,PARENT_QUERY,query);
+                this->mesh.flush();
+                char type;
+                string reply;
+                this->mesh.receive_from(rank,type,reply);
+                size_t offset = 0;
+                record.parent_rank = get_value<int32_t>(reply,offset);
+                record.parent_id = get_value<int32_t>(reply,offset);
+                record.action = get_value<int32_t>(reply,offset);
+            }
+            if(record.parent_rank==-1)
+                break;
+            plan.push_back(record.action);
+        }
+        reverse(plan.begin(),plan.end());
+        return plan;
+    }
+
+public:
+    DistributedSearch(const GroundedTask &task, SocketMesh &mesh): task(task),fdr(task),actions(task),mesh(mesh)
+    {
+        this->state_bytes = this->fdr.packed_bytes();
+    }
+
+    // Runs the search on this process. Returns true on rank 0 when a plan was found.
+    bool search(vector<int> &plan)
+    {
+        string packed = this->fdr.pack(this->task.initial_state);
+        if(this->owner(packed)==this->mesh.get_rank())
+            this->insert(packed,Record{-1,-1,-1},this->task.satisfies(this->task.initial_state,this->task.goal));
+
+        while(true)
+        {
+            int goal_rank = -1, goal_node = -1;
+            bool go_on;
+            if(this->mesh.get_rank()==0)
+                go_on = this->coordinate(goal_rank,goal_node) && !search_cancelled();
+            else
+            {
+                this->mesh.send(0,REPORT,this->report());
+                this->mesh.flush();
+                char type;
+                string payload;
+                this->mesh.receive_from(0,type,payload);
+                if(type!=DECISION)
+                    throw runtime_error("Unexpected distributed search message " + to_string((int)type));
+                size_t offset = 0;
+                go_on = get_value<char>(payload,offset);
+            }
+
+            if(!go_on)
+            {
+                if(this->mesh.get_rank()!=0)
+                {
+                    this->serve_parent_queries();
+                    return false;
+                }
+                if(goal_rank!=-1)
+                    plan = this->reconstruct(goal_rank,goal_node);
+                for(int peer=1;peer<this->mesh.size();peer++)
+                    this->mesh.send(peer,SHUTDOWN,"");
+                this->mesh.flush();
+                return goal_rank!=-1;
+            }
+            this->layer.swap(this->next_layer);
+            this->next_layer.clear();
+            this->expand_layer();
+        }
+    }
+};
+
+//=====================================================================================================================
+
+// Identifies the grounded task, so that processes on different machines can check that they agree on atom and action
+// ids before they exchange states.
+uint64_t task_fingerprint(const GroundedTask &task)
+{
+    uint64_t hash = fnv1a_hash(nullptr,0);
+    for(const auto &atom:task.atoms)
+    {
+        auto name = atom.toString();
+        hash = fnv1a_hash(name.data(),name.size(),hash);
+    }
+    for(const auto &gaction:task.actions)
+    {
+        auto name = gaction.toString();
+        hash = fnv1a_hash(name.data(),name.size(),hash);
+    }
+    return hash;
+}
+
+//=====================================================================================================================
+
+// Distributed search. With PLANNER_DISTRIBUTED_PEERS every rank is a separate planner process, possibly on another
+// machine, started with the same task and its own PLANNER_DISTRIBUTED_RANK; rank 0 returns the plan and the others
+// return an empty plan once rank 0 is done. Without peers, distributed_workers processes are forked on this machine
+// and connected by Unix socket pairs.
+list<GroundedAction> distributed_planner(const GroundedTask &task)
+{
+    auto search_start = chrono::steady_clock::now();
+    vector<pid_t> children;
+    unique_ptr<SocketMesh> mesh;
+    vector<int> plan;
+    bool found = false;
+    try
+    {
+        if(!distributed_peers.empty())
+        {
+            auto addresses = parse_symbols(distributed_peers);
+            if(distributed_rank<0 || distributed_rank>=(int)addresses.size())
+                throw runtime_error("PLANNER_DISTRIBUTED_RANK must be between 0 and " + to_string(addresses.size()-1));
+            mesh.reset(new SocketMesh(distributed_rank,addresses.size()));
+            mesh->connect_tcp(vector<string>(addresses.begin(),addresses.end()),task_fingerprint(task),
+                              distributed_connect_timeout);
+        }
+        else
+        {
+            const int size = max(1,distributed_workers);
+            vector<vector<int>> fds(size,vector<int>(size,-1));      //fds[i][j] is the end of i's socket to j
+            for(int i=0;i<size;i++)
+            {
+                for(int j=i+1;j<size;j++)
+                {
+                    int pair[2];
+                    if(socketpair(AF_UNIX,SOCK_STREAM,0,pair)!=0)
+                        throw runtime_error(string("Unable to create a socket pair: ") + strerror(errno));
+                    fds[i][j] = pair[0];
+                    fds[j][i] = pair[1];
+                }
+            }
+            cout.flush();
+            cerr.flush();
+            int rank = 0;
+            for(int r=1;r<size && rank==0;r++)
+            {
+                pid_t pid = fork();
+                if(pid<0)
+                    throw runtime_error(string("Unable to start a distributed search worker: ") + strerror(errno));
+                if(pid==0)
+                    rank = r;
+                else
+                    children.push_back(pid);
+            }
+            mesh.reset(new SocketMesh(rank,size));
+            for(int i=0;i<size;i++)
+            {
+                for(int j=0;j<size;j++)
+                {
+                    if(i==j)
+                        continue;
+                    if(i==rank)
+                        mesh->attach(j,fds[i][j]);
+                    else
+                        close(fds[i][j]);
+                }
+            }
+            if(rank!=0)
+            {
+                // Forked workers only search; the plan and every output come from rank 0
+                int status = 0;
+                try
+                {
+                    DistributedSearch(task,*mesh).search(plan);
+                }
+                catch(const exception &e)
+                {
+                    cerr<<"Distributed search worker "<<rank<<": "<<e.what()<<endl;
+                    status = 1;
+                }
+                mesh.reset();
+                _exit(status);
+            }
+        }
+        if(log_enabled(LOG_INFO))
+            cout<<"Distributed search rank "<<mesh->get_rank()<<" of "<<mesh->size()<<endl;
+        found = DistributedSearch(task,*mesh).search(plan);
+    }
+    catch(const exception &e)
+    {
+        cerr<<"Distributed search failed: "<<e.what()<<endl;
+        for(pid_t child:children)
+            kill(child,SIGTERM);
+        found = false;
+    }
+    mesh.reset();
+    for(pid_t child:children)
+        waitpid(child,nullptr,0);
+    search_stats.search_seconds = seconds_since(search_start);
+
+    list<GroundedAction> actions;
+    if(found)
+    {
+        if(log_enabled(LOG_INFO))
+            cout<<"PATH FOUND"<<endl;
+        actions = task.to_plan(plan);
+        search_stats.solved = true;
+        search_stats.plan_length = actions.size();
+    }
+    else if(log_enabled(LOG_INFO))
+        cout<<"PATH NOT FOUND"<<endl;
+    return actions;
+}
+
+//=====================================================================================================================
+
+int search_mode_from_name(const string &mode_name)
+{
+    if(mode_name=="astar")
+        return SEARCH_ASTAR;
+    if(mode_name=="regression")
+        return SEARCH_REGRESSION;
+    if(mode_name=="bidirectional")
+        return SEARCH_BIDIRECTIONAL;
+    if(mode_name=="idastar")
+        return SEARCH_IDASTAR;
+    if(mode_name=="external")
+        return SEARCH_EXTERNAL;
+    if(mode_name=="incremental")
+        return SEARCH_INCREMENTAL;
+    if(mode_name=="portfolio")
+        return SEARCH_PORTFOLIO;
+    if(mode_name=="lifted")
+        return SEARCH_LIFTED;
+    if(mode_name=="iw")
+        return SEARCH_IW;
+    if(mode_name=="bfws")
+        return SEARCH_BFWS;
+    if(mode_name=="beam")
+        return SEARCH_BEAM;
+    if(mode_name=="distributed")
+        return SEARCH_DISTRIBUTED;
+    throw runtime_error("Unknown search mode " + mode_name);
+}
+
+//=====================================================================================================================
+
+// Runs one of the searches over an already grounded task. Incremental and portfolio search are not single searches
+// and are dispatched by planner().
+list<GroundedAction> run_search(Env* env, const GroundedTask &task, int mode)
+{
+    if(mode==SEARCH_REGRESSION)
+        return regression_planner(task);
+    if(mode==SEARCH_BIDIRECTIONAL)
+        return bidirectional_planner(task);
+    if(mode==SEARCH_IDASTAR)
+        return idastar_planner(task);
+    if(mode==SEARCH_EXTERNAL)
+        return external_planner(task);
+    if(mode==SEARCH_IW)
+        return iw_planner(task);
+    if(mode==SEARCH_BFWS)
+        return bfws_planner(task);
+    if(mode==SEARCH_BEAM)
+        return beam_planner(task);
+    if(mode==SEARCH_DISTRIBUTED)
+        return distributed_planner(task);
+    if(mode==SEARCH_ASTAR)
+        return astar_planner(env,&task);
+    if(mode==SEARCH_LIFTED)
+        return astar_planner(env,nullptr);
+    throw runtime_error("Search mode " + to_string(mode) + " cannot run on a grounded task");
+}
+
+//=====================================================================================================================
+
+// A portfolio configuration is a search mode followed by options, e.g. "astar+stubborn+symmetry".
+struct PortfolioConfiguration
+{
+    string name;
+    int search_mode;
+    bool stubborn_sets;
+    bool symmetry;
+};
+
+vector<PortfolioConfiguration> parse_portfolio_configurations(const string &configurations)
+{
+    vector<PortfolioConfiguration> parsed;
+    for(const auto &name:parse_symbols(configurations))
+    {
+        if(name.empty())
+            continue;
+        PortfolioConfiguration configuration{name,SEARCH_ASTAR,false,false};
+        stringstream parts(name);
+        string part;
+        getline(parts,part,'+');
+        configuration.search_mode = search_mode_from_name(part);
+        if(configuration.search_mode==SEARCH_INCREMENTAL || configuration.search_mode==SEARCH_PORTFOLIO
+           || configuration.search_mode==SEARCH_DISTRIBUTED)
+            throw runtime_error("Search mode " + part + " cannot be part of a portfolio");
+        while(getline(parts,part,'+'))
+        {
+            if(part=="stubborn")
+                configuration.stubborn_sets = true;
+            else if(part=="symmetry")
+                configuration.symmetry = true;
+            else
+                throw runtime_error("Unknown portfolio option " + part);
+        }
+        parsed.push_back(configuration);
+    }
+    if(parsed.empty())
+        throw runtime_error("The portfolio has no configurations");
+    return parsed;
+}
+
+//=====================================================================================================================
+
+struct PortfolioResult
+{
+    bool definite = false;      //A plan, or a complete search that proved there is none
+    list<GroundedAction> plan;
+    SearchStatistics stats;
+};
+
+// Runs the portfolio configurations on one thread each, all sharing the grounded task, which no search modifies. The
+// first definite result wins, or with a deadline the shortest plan found by then (a proof that no plan exists ends the
+// wait too). The other searches are then cancelled and joined, and the statistics of the winner are reported.
+list<GroundedAction> portfolio_planner(Env* env, const GroundedTask &task)
+{
+    const auto configurations = parse_portfolio_configurations(portfolio_configurations);
+    auto search_start = chrono::steady_clock::now();
+    atomic<bool> cancelled{false};
+    mutex results_mutex;
+    condition_variable result_ready;
+    vector<PortfolioResult> results(configurations.size());
+    vector<int> finish_order;
+    const string portfolio_trace_file = trace_file;
+
+    vector<thread> workers;
+    for(int i=0;i<(int)configurations.size();i++)
+    {
+        workers.emplace_back([&,i]()
+        {
+            const auto &configuration = configurations[i];
+            cancel_flag = &cancelled;
+            use_stubborn_sets = configuration.stubborn_sets;
+            use_symmetry_pruning = configuration.symmetry;
+            trace_file = portfolio_trace_file=="" ? "" : portfolio_trace_file + "." + configuration.name;
+            if(trace_file!="" && !search_mode_traces(configuration.search_mode))
+            {
+                lock_guard<mutex> lock(results_mutex);
+                cerr<<"Warning: portfolio configuration "<<configuration.name<<" does not record PLANNER_TRACE"<<endl;
+            }
+            PortfolioResult result;
+            try
+            {
+                result.plan = run_search(env,task,configuration.search_mode);
+                result.definite = search_stats.solved || (!search_stats.out_of_memory && !search_cancelled());
+            }
+            catch(const exception &e)
+            {
+                cerr<<"Portfolio configuration "<<configuration.name<<" failed: "<<e.what()<<endl;
+            }
+            result.stats = search_stats;
+            lock_guard<mutex> lock(results_mutex);
+            results[i] = std::move(result);
+            finish_order.push_back(i);
+            result_ready.notify_all();
+        });
+    }
+
+    auto decided = [&]()
+    {
+        if(finish_order.size()==configurations.size())
+            return true;
+        for(int i:finish_order)
+            if(results[i].definite && (portfolio_deadline<=0 || !results[i].stats.solved))
+                return true;
+        return false;
+    };
+    {
+        unique_lock<mutex> lock(results_mutex);
+        if(portfolio_deadline>0)
+            result_ready.wait_until(lock,search_start+chrono::duration<double>(portfolio_deadline),decided);
+        else
+            result_ready.wait(lock,decided);
+    }
+    cancelled = true;
+    for(auto &worker:workers)
+        worker.join();
+
+    // Searches that were already done when the others got cancelled count too, in the order they finished
+    int winner = -1;
+    for(int i:finish_order)
+    {
+        if(!results[i].definite)
+            continue;
+        if(winner==-1)
+            winner = i;
+        else if(portfolio_deadline>0 && results[i].stats.solved
+                && (!results[winner].stats.solved || results[i].plan.size()<results[winner].plan.size()))
+            winner = i;
+    }
+    if(winner==-1)
+    {
+        search_stats.search_seconds = seconds_since(search_start);
+        if(log_enabled(LOG_INFO))
+            cout<<"No portfolio configuration finished"<<endl;
+        return list<GroundedAction>();
+    }
+
+    if(log_enabled(LOG_INFO))
+        cout<<"Portfolio winner: "<<configurations[winner].name<<endl;
+    double parse_seconds = search_stats.parse_seconds;
+    double grounding_seconds = search_stats.grounding_seconds;
+    search_stats = results[winner].stats;
+    search_stats.parse_seconds = parse_seconds;
+    search_stats.grounding_seconds = grounding_seconds;
+    search_stats.search_seconds = seconds_since(search_start);
+    search_stats.portfolio_winner = configurations[winner].name;
+    return std::move(results[winner].plan);
+}
+
+//=====================================================================================================================
+
+void load_planner_config()
+{
+    static bool loaded = false;
+    if(loaded)
+        return;
+    loaded = true;
+
+    if(const char* cache_dir = getenv("PLANNER_PLAN_CACHE"))
+    {
+        plan_cache_enabled = true;
+        if(*cache_dir)
+            plan_cache_dir = cache_dir;
+    }
+    if(const char* directory = getenv("PLANNER_MACROS"))
+    {
+        use_macros = true;
+        if(*directory)
+            macro_dir = directory;
+    }
+    if(const char* learn = getenv("PLANNER_MACRO_LEARN"))
+        learn_new_macros = atoi(learn)!=0;
+    if(const char* length = getenv("PLANNER_MACRO_LENGTH"))
+        macro_max_length = max(2,atoi(length));
+    if(const char* support = getenv("PLANNER_MACRO_MIN_SUPPORT"))
+        macro_min_support = max(1,atoi(support));
+    if(const char* limit = getenv("PLANNER_MACRO_LIMIT"))
+        macro_limit = strtoul(limit,nullptr,10);
+    if(const char* parameters = getenv("PLANNER_MACRO_MAX_PARAMS"))
+        macro_max_parameters = max(1,atoi(parameters));
+    if(const char* capacity = getenv("PLANNER_PLAN_CACHE_CAPACITY"))
+        plan_cache_capacity = strtoul(capacity,nullptr,10);
+    if(const char* stats_path = getenv("PLANNER_STATS"))
+        stats_file = stats_path;
+    if(const char* trace_path = getenv("PLANNER_TRACE"))
+        trace_file = trace_path;
+    if(const char* sample_rate = getenv("PLANNER_TRACE_SAMPLE"))
+        trace_sample_rate = atof(sample_rate);
+    if(const char* stubborn = getenv("PLANNER_STUBBORN_SETS"))
+        use_stubborn_sets = atoi(stubborn)!=0;
+    if(const char* trial = getenv("PLANNER_STUBBORN_TRIAL"))
+        stubborn_trial_expansions = max(0LL,atoll(trial));
+    if(const char* table_size = getenv("PLANNER_TT_SIZE"))
+        transposition_table_size = strtoull(table_size,nullptr,10);
+    if(const char* directory = getenv("PLANNER_EXTERNAL_DIR"))
+        external_search_dir = directory;
+    if(const char* budget = getenv("PLANNER_EXTERNAL_BUDGET_MB"))
+        external_memory_budget = (size_t)atof(budget) * (1 << 20);
+    if(const char* limit = getenv("PLANNER_MEMORY_LIMIT_MB"))
+        memory_limit_bytes = (size_t)(atof(limit) * (1 << 20));
+    if(const char* width = getenv("PLANNER_MEMORY_BEAM_WIDTH"))
+        memory_beam_width = max<size_t>(1,strtoul(width,nullptr,10));
+    if(const char* policy = getenv("PLANNER_MEMORY_POLICY"))
+    {
+        string policy_name = policy;
+        if(policy_name=="stop")
+            memory_policy = MEMORY_STOP;
+        else if(policy_name=="evict")
+            memory_policy = MEMORY_EVICT;
+        else if(policy_name=="beam")
+            memory_policy = MEMORY_BEAM;
+        else
+            throw runtime_error("Unknown memory policy " + policy_name);
+    }
+    if(const char* kernel = getenv("PLANNER_SIMD"))
+    {
+        string kernel_name = kernel;
+        if(kernel_name=="auto")
+            applicability_kernel = SCAN_AUTO;
+        else if(kernel_name=="scalar")
+            applicability_kernel = SCAN_SCALAR;
+        else if(kernel_name=="sse2")
+            applicability_kernel = SCAN_SSE2;
+        else if(kernel_name=="avx2")
+            applicability_kernel = SCAN_AVX2;
+        else
+            throw runtime_error("Unknown applicability kernel " + kernel_name);
+    }
+    if(const char* workers = getenv("PLANNER_DISTRIBUTED_WORKERS"))
+        distributed_workers = max(1,atoi(workers));
+    if(const char* peers = getenv("PLANNER_DISTRIBUTED_PEERS"))
+        distributed_peers = peers;
+    if(const char* rank = getenv("PLANNER_DISTRIBUTED_RANK"))
+        distributed_rank = atoi(rank);
+    if(const char* width = getenv("PLANNER_BEAM_WIDTH"))
+        beam_width = max<size_t>(1,strtoul(width,nullptr,10));
+    if(const char* restarts = getenv("PLANNER_BEAM_RESTARTS"))
+        beam_restarts = max(0,atoi(restarts));
+    if(const char* threads = getenv("PLANNER_BEAM_THREADS"))
+        beam_threads = strtoul(threads,nullptr,10);
+    if(const char* depth = getenv("PLANNER_BEAM_MAX_DEPTH"))
+        beam_max_depth = max(1,atoi(depth));
+    if(const char* width = getenv("PLANNER_NOVELTY_WIDTH"))
+        novelty_max_width = max(1,min(2,atoi(width)));
+    if(const char* relevance = getenv("PLANNER_RELEVANCE"))
+        use_relevance_analysis = atoi(relevance)!=0;
+    if(const char* h2 = getenv("PLANNER_H2"))
+        use_h2_mutexes = atoi(h2)!=0;
+    if(const char* symmetry = getenv("PLANNER_SYMMETRY"))
+        use_symmetry_pruning = atoi(symmetry)!=0;
+    if(const char* mode = getenv("PLANNER_SEARCH"))
+        search_mode = search_mode_from_name(mode);
+    if(const char* configurations = getenv("PLANNER_PORTFOLIO"))
+        portfolio_configurations = configurations;
+    if(const char* deadline = getenv("PLANNER_PORTFOLIO_DEADLINE"))
+        portfolio_deadline = atof(deadline);
+    if(const char* level = getenv("PLANNER_LOG_LEVEL"))
+    {
+        string level_name = level;
+        if(level_name=="silent")
+            log_level = LOG_SILENT;
+        else if(level_name=="info")
+            log_level = LOG_INFO;
+        else if(level_name=="debug")
+            log_level = LOG_DEBUG;
+        else
+            log_level = atoi(level);
+    }
+}
+
+//=====================================================================================================================
+
+void write_statistics()
+{
+    if(stats_file=="")
+        return;
+    if(stats_file=="-")
+    {
+        search_stats.write_json(cerr);
+        return;
+    }
+    ofstream stats_output(stats_file);
+    if(stats_output.is_open())
+        search_stats.write_json(stats_output);
+}
+
+//=====================================================================================================================
+
+// Whether the plans of a search mode are shortest plans under the current settings
+bool search_mode_is_optimal(int mode)
+{
+    if(mode==SEARCH_IW || mode==SEARCH_BFWS || mode==SEARCH_BEAM)
+        return false;
+    if((mode==SEARCH_ASTAR || mode==SEARCH_LIFTED) && memory_limit_bytes>0 && memory_policy!=MEMORY_STOP)
+        return false;
+    if(mode==SEARCH_PORTFOLIO)
+    {
+        for(const auto &configuration:parse_portfolio_configurations(portfolio_configurations))
+            if(!search_mode_is_optimal(configuration.search_mode))
+                return false;
+    }
+    return true;
+}
+
+//=====================================================================================================================
+
+// Part of the plan cache key. Optimal configurations share their plans, since any shortest plan answers them all;
+// every other configuration only gets back the plans it found itself.
+string plan_cache_configuration()
+{
+    if(search_mode_is_optimal(search_mode) && !use_macros)
+        return "optimal;";
+    string configuration = "mode" + to_string(search_mode);
+    if(memory_limit_bytes>0)
+        configuration += "+memory" + to_string(memory_policy);
+    if(search_mode==SEARCH_PORTFOLIO)
+        configuration += "+" + portfolio_configurations;
+    if(use_macros)
+        configuration += "+macros";
+    return configuration + ";";
+}
+
+//=====================================================================================================================
+
+list<GroundedAction> planner(Env* env)
+{
+    load_planner_config();
+
+    string cache_key;
+    if(plan_cache_enabled)
+    {
+        cache_key = plan_cache_key(env,plan_cache_configuration());
+        list<GroundedAction> cached_plan;
+        if(get_plan_cache().lookup(cache_key,env,cached_plan))
+        {
+            if(log_enabled(LOG_INFO))
+                cout<<"Plan cache hit"<<endl;
+            search_stats.cache_hit = true;
+            search_stats.solved = true;
+            search_stats.plan_length = cached_plan.size();
+            write_statistics();
+            return cached_plan;
+        }
+    }
+
+    if(trace_file!="" && !search_mode_traces(search_mode))
+        cerr<<"Warning: PLANNER_TRACE is only recorded by the astar, regression, bidirectional, bfws and portfolio "
+            <<"search modes; this search writes no trace"<<endl;
+
+    // Lifted search joins the schemas of env directly and incremental search keeps its grounded task across queries,
+    // so neither uses macros; their plans still go into the corpus
+    active_macros.clear();
+    if(use_macros && search_mode!=SEARCH_LIFTED && search_mode!=SEARCH_INCREMENTAL)
+        active_macros = load_macros(env);
+    search_stats.macro_schemas = active_macros.size();
+
+    list<GroundedAction> actions;
+    if(search_mode==SEARCH_INCREMENTAL)
+        actions = incremental_planner(env);     //Grounds only when the task changed
+    else if(search_mode==SEARCH_LIFTED)
+        actions = astar_planner(env,nullptr);
+    else
+    {
+        const GroundedTask task = ground_task(env);
+        if(search_mode==SEARCH_PORTFOLIO)
+            actions = portfolio_planner(env,task);
+        else
+            actions = run_search(env,task,search_mode);
+    }
+    if(!active_macros.empty())
+    {
+        actions = expand_macros(env,actions);
+        if(search_stats.solved)
+            search_stats.plan_length = actions.size();
+    }
+
+    bool valid_plan = (plan_cache_enabled || use_macros) && validate_plan(env,actions);
+    if(plan_cache_enabled && valid_plan)
+        get_plan_cache().store(cache_key,actions);
+    if(use_macros && learn_new_macros && valid_plan && !actions.empty())
+        learn_macros(env,actions);
+
+    write_statistics();
+    return actions;
+}
+
+#ifndef PLANNER_NO_MAIN     //Defined by tools that include this file, e.g. microbench.cpp
+int main(int argc, char* argv[])
+{
+    // DO NOT CHANGE THIS FUNCTION
+    char* filename = (char*)("example.txt");
+    if (argc > 1)
+        filename = argv[1];
+
+    cout << "Environment: " << filename << endl << endl;
+    Env* env = create_env(filename);
+    if (print_status)
+    {
+        cout << *env;
+    }
+
+    list<GroundedAction> actions = planner(env);
+
+    cout << "\nPlan: " << endl;
+    for (GroundedAction gac : actions)
+    {
+        cout << gac << endl;
+    }
+
+    return 0;
+}
+#endif
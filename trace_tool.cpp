@@ -0,0 +1,115 @@
+// Converts a binary search trace written by the planner (PLANNER_TRACE) to CSV or Graphviz DOT.
+//
+// Compilation: g++ -std=c++11 -O2 -pthread trace_tool.cpp -o trace_tool
+// Run:         ./trace_tool trace.bin --csv > trace.csv
+//              ./trace_tool trace.bin --dot > trace.dot
+
+#define PLANNER_NO_MAIN
+#include "planner.cpp"
+
+struct Trace
+{
+    TraceHeader header;
+    vector<TraceEvent> events;
+    vector<string> action_names;
+};
+
+//=====================================================================================================================
+
+bool read_trace(const char* path, Trace &trace)
+{
+    FILE* file = fopen(path,"rb");
+    if(!file)
+    {
+        cerr<<"Unable to open "<<path<<endl;
+        return false;
+    }
+
+    bool ok = fread(&trace.header,sizeof(trace.header),1,file)==1
+              && memcmp(trace.header.magic,trace_magic,sizeof(trace_magic))==0
+              && trace.header.event_size==sizeof(TraceEvent);
+    if(!ok)
+    {
+        cerr<<path<<" is not a planner trace (or was not closed cleanly)"<<endl;
+        fclose(file);
+        return false;
+    }
+
+    trace.events.resize(trace.header.event_count);
+    ok = fread(trace.events.data(),sizeof(TraceEvent),trace.events.size(),file)==trace.events.size();
+    for(uint64_t i=0;ok && i<trace.header.action_count;i++)
+    {
+        uint32_t length = 0;
+        ok = fread(&length,sizeof(length),1,file)==1;
+        string name(length,' ');
+        ok = ok && fread(&name[0],1,length,file)==length;
+        trace.action_names.push_back(name);
+    }
+    fclose(file);
+    if(!ok)
+        cerr<<path<<" is truncated"<<endl;
+    return ok;
+}
+
+//=====================================================================================================================
+
+string action_name(const Trace &trace, int action_id)
+{
+    if(action_id<0 || action_id>=(int)trace.action_names.size())
+        return "";
+    return trace.action_names[action_id];
+}
+
+//=====================================================================================================================
+
+void write_csv(const Trace &trace, ostream &os)
+{
+    os<<"time_ns,node_id,parent_id,action_id,action,g,h"<<endl;
+    uint64_t first = trace.events.empty() ? 0 : trace.events.front().timestamp;
+    for(const auto &event:trace.events)
+    {
+        double time_ns = (event.timestamp-first) * 1e9 / trace.header.ticks_per_second;
+        os<<(uint64_t)time_ns<<","<<event.node_id<<","<<event.parent_id<<","<<event.action_id<<",\""
+          <<action_name(trace,event.action_id)<<"\","<<event.gcost<<","<<event.hcost<<endl;
+    }
+}
+
+//=====================================================================================================================
+
+void write_dot(const Trace &trace, ostream &os)
+{
+    os<<"digraph search {"<<endl;
+    os<<"  node [shape=box, fontsize=10];"<<endl;
+    int order = 0;
+    for(const auto &event:trace.events)
+    {
+        os<<"  n"<<event.node_id<<" [label=\"#"<<order++<<" node "<<event.node_id<<"\\ng="<<event.gcost
+          <<" h="<<event.hcost<<"\"];"<<endl;
+        if(event.parent_id>=0)
+            os<<"  n"<<event.parent_id<<" -> n"<<event.node_id<<" [label=\""<<action_name(trace,event.action_id)<<"\"];"<<endl;
+    }
+    os<<"}"<<endl;
+}
+
+//=====================================================================================================================
+
+int main(int argc, char* argv[])
+{
+    if(argc<3 || (string(argv[2])!="--csv" && string(argv[2])!="--dot"))
+    {
+        cout<<"Usage: "<<argv[0]<<" TRACE_FILE --csv|--dot"<<endl;
+        return 1;
+    }
+
+    Trace trace;
+    if(!read_trace(argv[1],trace))
+        return 1;
+    if(trace.header.dropped_events)
+        cerr<<"Warning: "<<trace.header.dropped_events<<" events were dropped while recording"<<endl;
+
+    if(string(argv[2])=="--csv")
+        write_csv(trace,cout);
+    else
+        write_dot(trace,cout);
+    return 0;
+}